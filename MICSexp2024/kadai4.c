@@ -1,1045 +1,5338 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <time.h>   // clock() / clock_t で時間計測
+#include <time.h>   // 時間計測
+#include <stdint.h>
+#include <limits.h>
+#include <pthread.h>
+#if !defined(_WIN32)
+#include <sys/time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <errno.h>
+#endif
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#endif
 
-#define BUCKET_SIZE 200000   // ハッシュテーブルサイズ(大規模なら適宜変更)
-#define MAX_ITEMS_IN_TRANSACTION 20000
+#define MAX_ITEMSET_LEN 64   // 扱うアイテムセットの最大長 (パス数の上限)
+#define PAIR_MATRIX_BUDGET (512LL*1024*1024)  // パス2の三角行列に使ってよいバイト数
+#define CANDIDATE_PRESIZE_MAX (1LL<<24)       // C_k の表を前もって広げる件数の上限
+#define ITEM_PRESIZE 4096                    // パス1の表の最初の見込み件数
 
 // ------------------------------
 // 性能評価用のグローバル変数
 // ------------------------------
 static long long searchItem_calls = 0;       // searchItem呼び出し回数
-static long long searchItem_traversals = 0;  // searchItem内でチェーンを辿った回数
+static long long searchItem_traversals = 0;  // searchItem内で見たスロット数
 
-static long long searchPair_calls = 0;
-static long long searchPair_traversals = 0;
-
-static long long searchTriple_calls = 0;
-static long long searchTriple_traversals = 0;
+// searchItemset の呼び出し回数/見たスロット数 (長さkごと)
+//   k=2 が従来の searchPair, k=3 が searchTriple に相当
+static long long searchItemset_calls[MAX_ITEMSET_LEN+1];
+static long long searchItemset_traversals[MAX_ITEMSET_LEN+1];
 
 static long long generated_rules = 0;  // 出力されたルールの数
 
 // 時間計測 (各パスの所要時間) 用
-static double pass1_time = 0.0;
-static double pass2_time = 0.0;
-static double pass3_time = 0.0;
+//   pass_time[k] がパスk (L_k の生成) の所要時間
+static double pass_time[MAX_ITEMSET_LEN+1];
 static double rule_time  = 0.0;
 
-// C言語では clock() を使う場合、1秒あたりのクロック数はCLOCKS_PER_SEC
-// CPU時間計測の簡易版として利用 (実時間が欲しければ gettimeofday等を使用)
+// 複数スレッドで数えるとCPU時間(clock())は合計になってしまうので、
+// 各パスの時間は gettimeofday による実時間で測る
+static double nowSec() {
+#if defined(_WIN32)
+    return (double)clock() / CLOCKS_PER_SEC;
+#else
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (double)tv.tv_sec + (double)tv.tv_usec * 1e-6;
+#endif
+}
 
 static double MIN_SUPPORT_RATIO = 0.0;
 static double MIN_CONFIDENCE = 0.0;
 static long long TOTAL_TRANSACTIONS = 0;
+static int NUM_THREADS = 1;   // 頻度カウントのスレッド数 (--threads)
+
+// マイニング方式 (--engine)
+#define ENGINE_APRIORI  0
+#define ENGINE_FPGROWTH 1
+#define ENGINE_ECLAT    2
+static int MINING_ENGINE = ENGINE_APRIORI;
 
 // ==================================================
-// パス1用 (単一アイテム) の構造とハッシュ
+// アリーナ (ブロック単位のメモリ確保)
+//   sampleMemblock.c の intblock (AllocIntBlock/GetIntBuff) と同じく、
+//   大きなブロックを malloc して先頭から切り出して使う。型を問わず
+//   ARENA_NEW(a, 型, 個数) で確保し、個別には解放しない。
+//   arenaGetMark で位置を覚えておき、arenaRelease でそれ以降に確保した
+//   分をまとめて返す (深さ優先の再帰やパスごとの表に使う)。
+//   返したブロックは捨てずに取っておき、次の確保で使い回す。
+//   解放はブロック数に比例する時間で済む。
 // ==================================================
-struct itemNode {
-    int item;
-    long long count;
-    struct itemNode *next;
+#define ARENA_BLOCK_SIZE (256*1024)   // 標準のブロックの大きさ (バイト)
+#define ARENA_ALIGN 16
+
+struct arenaBlock {
+    struct arenaBlock *next;   // 次のブロック
+    size_t size;               // データ部の大きさ
+};
+#define ARENA_HEADER ((sizeof(struct arenaBlock) + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1))
+
+struct memArena {
+    struct arenaBlock *top;    // 先頭のブロック
+    struct arenaBlock *cur;    // 現在のブロック (末尾)
+    char *p;                   // 現在のブロックの未使用領域の先頭
+    size_t rest;               // 現在のブロックの未使用バイト数
+    size_t blockSize;
+    struct arenaBlock *spare;  // 返されて再利用を待つ標準サイズのブロック
 };
-static struct itemNode *itemHash[BUCKET_SIZE];
+struct arenaMark {
+    struct arenaBlock *block;
+    char *p;
+    size_t rest;
+};
+
+static long long arena_bytes = 0;   // アリーナが malloc で持っているバイト数
+static long long arena_peak = 0;    // その最大値
 
-void initItemHash() {
-    for (int i = 0; i < BUCKET_SIZE; i++) {
-        itemHash[i] = NULL;
+struct memArena* createArena(size_t blockSize) {
+    struct memArena *a = (struct memArena*)calloc(1, sizeof(struct memArena));
+    if (!a) {
+        fprintf(stderr, "Error: malloc failed\n");
+        exit(1);
     }
+    a->blockSize = blockSize;
+    return a;
 }
-int hashItem(int item) {
-    long long key = (long long)item * 31LL;
-    long long idx = key % BUCKET_SIZE;
-    if (idx < 0) idx += BUCKET_SIZE;
-    return (int)idx;
+static struct arenaBlock* allocArenaBlock(size_t size) {
+    struct arenaBlock *b = (struct arenaBlock*)malloc(ARENA_HEADER + size);
+    if (!b) {
+        fprintf(stderr, "Error: malloc for arena block\n");
+        exit(1);
+    }
+    b->next = NULL;
+    b->size = size;
+    arena_bytes += (long long)(ARENA_HEADER + size);
+    if (arena_bytes > arena_peak) arena_peak = arena_bytes;
+    return b;
 }
-struct itemNode* searchItem(int item) {
-    // インストルメンテーション: 回数カウント
-    searchItem_calls++;
+static void freeArenaBlocks(struct arenaBlock *b) {
+    while (b) {
+        struct arenaBlock *tmp = b;
+        b = b->next;
+        arena_bytes -= (long long)(ARENA_HEADER + tmp->size);
+        free(tmp);
+    }
+}
+void* arenaAlloc(struct memArena *a, size_t size) {
+    size = (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+    if (size > a->rest) {
+        // 足りなければ次のブロックへ (大きな要求はその大きさのブロックを作る)
+        struct arenaBlock *b;
+        if (size <= a->blockSize && a->spare) {
+            b = a->spare;
+            a->spare = b->next;
+            b->next = NULL;
+        } else {
+            b = allocArenaBlock(size > a->blockSize ? size : a->blockSize);
+        }
+        if (a->cur) a->cur->next = b;
+        else a->top = b;
+        a->cur = b;
+        a->p = (char*)b + ARENA_HEADER;
+        a->rest = b->size;
+    }
+    void *r = a->p;
+    a->p += size;
+    a->rest -= size;
+    return r;
+}
+#define ARENA_NEW(a, type, n) ((type*)arenaAlloc((a), sizeof(type) * (size_t)(n)))
 
-    int h = hashItem(item);
-    struct itemNode *p = itemHash[h];
-    while (p) {
-        // チェーンを1要素辿るたびにインクリメント
-        searchItem_traversals++;
-        if (p->item == item) return p;
-        p = p->next;
+// 直前に確保した領域 last を size バイトに縮める
+void arenaTrim(struct memArena *a, void *last, size_t size) {
+    size = (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+    char *end = (char*)last + size;
+    a->rest += (size_t)(a->p - end);
+    a->p = end;
+}
+struct arenaMark arenaGetMark(struct memArena *a) {
+    struct arenaMark m;
+    m.block = a->cur;
+    m.p = a->p;
+    m.rest = a->rest;
+    return m;
+}
+// m 以降に確保した領域をまとめて返す
+void arenaRelease(struct memArena *a, struct arenaMark m) {
+    struct arenaBlock *b = m.block ? m.block->next : a->top;
+    while (b) {
+        struct arenaBlock *next = b->next;
+        if (b->size == a->blockSize) {
+            b->next = a->spare;
+            a->spare = b;
+        } else {
+            b->next = NULL;
+            freeArenaBlocks(b);
+        }
+        b = next;
     }
-    return NULL;
+    if (m.block) m.block->next = NULL;
+    else a->top = NULL;
+    a->cur = m.block;
+    a->p = m.p;
+    a->rest = m.rest;
+}
+void freeArena(struct memArena *a) {
+    if (!a) return;
+    freeArenaBlocks(a->top);
+    freeArenaBlocks(a->spare);
+    free(a);
+}
+
+// ==================================================
+// 開番地法のハッシュ表の共通部分 (struct openIndex)
+//   キーは uint64_t に詰めて持ち、スロットにはキーと「データの添字」を置く。
+//   頻度などのデータはキーとは別の密な配列に置く (表の外)。
+//   衝突は線形探索で解決する。表の大きさは期待件数から決め (2のべき)、
+//   使用率が OPEN_MAX_LOAD を超えたら倍の表を作って少しずつ移す
+//   (挿入のたびに古い表のスロットを OPEN_MIGRATE_STEP 個移す)。
+//   移し終わるまでは新しい表 → 古い表の順に探す。データは表の外にあるので、
+//   同じキーが両方の表にあっても指す先は同じになる。
+// ==================================================
+#define OPEN_EMPTY UINT64_MAX   // 空きスロットのキー
+#define OPEN_MIN_SLOTS 64       // 最小のスロット数
+#define OPEN_MAX_LOAD 0.5       // これを超えたら倍の表に移し始める
+#define OPEN_MIGRATE_STEP 16    // 1回の挿入で移す古い表のスロット数
+
+static inline uint64_t mixHash64(uint64_t x) {
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ULL;
+    x ^= x >> 33;
+    return x;
+}
+
+struct openIndex {
+    long long n;          // 登録数
+    long long nslots;     // スロット数 (2のべき)
+    uint64_t *keys;       // 各スロットのキー (空きは OPEN_EMPTY)
+    uint32_t *idx;        // 各スロットのデータの添字
+    long long oldSlots;   // 移している途中の古い表 (無ければ 0)
+    uint64_t *oldKeys;
+    uint32_t *oldIdx;
+    long long moved;      // 古い表のうち移し終えたスロット数
+};
+// キーが一致したときにデータ側で照合する関数 (キーがセットそのものなら NULL)
+typedef int (*openMatchFn)(const void *ctx, uint32_t idx);
+
+// expected 件入れても使用率が OPEN_MAX_LOAD 以下になるスロット数
+static long long openSlotsFor(long long expected) {
+    long long nslots = OPEN_MIN_SLOTS;
+    while ((double)expected > (double)nslots * OPEN_MAX_LOAD) nslots *= 2;
+    return nslots;
 }
-struct itemNode* createItemNode(int item) {
-    struct itemNode *n = (struct itemNode*)malloc(sizeof(struct itemNode));
-    if (!n) {
+static void allocOpenSlots(long long nslots, uint64_t **keys, uint32_t **idx) {
+    *keys = (uint64_t*)malloc(sizeof(uint64_t) * nslots);
+    *idx = (uint32_t*)malloc(sizeof(uint32_t) * nslots);
+    if (!*keys || !*idx) {
         fprintf(stderr, "Error: malloc failed\n");
         exit(1);
     }
-    n->item = item;
-    n->count = 1;
-    n->next = NULL;
-    return n;
+    memset(*keys, 0xFF, sizeof(uint64_t) * nslots);
 }
-void insertOrUpdateItem(int item) {
-    struct itemNode *found = searchItem(item);
-    if (found) {
-        found->count++;
-    } else {
-        int h = hashItem(item);
-        struct itemNode *n = createItemNode(item);
-        n->next = itemHash[h];
-        itemHash[h] = n;
+void initOpenIndex(struct openIndex *ix, long long expected) {
+    ix->n = 0;
+    ix->nslots = openSlotsFor(expected);
+    allocOpenSlots(ix->nslots, &ix->keys, &ix->idx);
+    ix->oldSlots = 0;
+    ix->oldKeys = NULL;
+    ix->oldIdx = NULL;
+    ix->moved = 0;
+}
+void freeOpenIndex(struct openIndex *ix) {
+    free(ix->keys);
+    free(ix->idx);
+    free(ix->oldKeys);
+    free(ix->oldIdx);
+    ix->keys = ix->oldKeys = NULL;
+    ix->idx = ix->oldIdx = NULL;
+    ix->nslots = ix->oldSlots = 0;
+    ix->n = 0;
+}
+// 空にする (表の大きさは変えない)
+void clearOpenIndex(struct openIndex *ix) {
+    free(ix->oldKeys);
+    free(ix->oldIdx);
+    ix->oldKeys = NULL;
+    ix->oldIdx = NULL;
+    ix->oldSlots = 0;
+    ix->moved = 0;
+    ix->n = 0;
+    memset(ix->keys, 0xFF, sizeof(uint64_t) * ix->nslots);
+}
+static inline void putOpenSlot(uint64_t *keys, uint32_t *idx, long long nslots, uint64_t key, uint32_t v) {
+    long long mask = nslots - 1;
+    long long h = (long long)(mixHash64(key) & (uint64_t)mask);
+    while (keys[h] != OPEN_EMPTY) h = (h + 1) & mask;
+    keys[h] = key;
+    idx[h] = v;
+}
+// 古い表から step スロット分を新しい表へ移す
+static void migrateOpenIndex(struct openIndex *ix, long long step) {
+    long long end = ix->moved + step;
+    if (end > ix->oldSlots) end = ix->oldSlots;
+    for (long long h = ix->moved; h < end; h++) {
+        if (ix->oldKeys[h] != OPEN_EMPTY) {
+            putOpenSlot(ix->keys, ix->idx, ix->nslots, ix->oldKeys[h], ix->oldIdx[h]);
+        }
+    }
+    ix->moved = end;
+    if (ix->moved >= ix->oldSlots) {
+        free(ix->oldKeys);
+        free(ix->oldIdx);
+        ix->oldKeys = NULL;
+        ix->oldIdx = NULL;
+        ix->oldSlots = 0;
+        ix->moved = 0;
     }
 }
-void freeItemHash() {
-    for (int i = 0; i < BUCKET_SIZE; i++) {
-        struct itemNode *p = itemHash[i];
-        while (p) {
-            struct itemNode *tmp = p;
-            p = p->next;
-            free(tmp);
+static long long probeOpenSlots(const uint64_t *keys, const uint32_t *idx, long long nslots, uint64_t key,
+                                openMatchFn match, const void *ctx, long long *probes) {
+    long long mask = nslots - 1;
+    for (long long h = (long long)(mixHash64(key) & (uint64_t)mask); ; h = (h + 1) & mask) {
+        (*probes)++;
+        if (keys[h] == key) {
+            if (!match || match(ctx, idx[h])) return idx[h];
+        } else if (keys[h] == OPEN_EMPTY) {
+            return -1;
         }
-        itemHash[i] = NULL;
     }
 }
+// key のデータの添字を返す。無ければ -1 (probes に見たスロット数を足す)
+long long findOpenIndex(const struct openIndex *ix, uint64_t key, openMatchFn match, const void *ctx,
+                        long long *probes) {
+    long long r = probeOpenSlots(ix->keys, ix->idx, ix->nslots, key, match, ctx, probes);
+    if (r < 0 && ix->oldSlots > 0) {
+        r = probeOpenSlots(ix->oldKeys, ix->oldIdx, ix->oldSlots, key, match, ctx, probes);
+    }
+    return r;
+}
+// key → v を登録する (重複していないことは呼び出し側が保証する)
+void insertOpenIndex(struct openIndex *ix, uint64_t key, uint32_t v) {
+    if (ix->oldSlots > 0) migrateOpenIndex(ix, OPEN_MIGRATE_STEP);
+    if ((double)(ix->n + 1) > (double)ix->nslots * OPEN_MAX_LOAD) {
+        // 前の移動が終わっていなければ先に終わらせてから、倍の表に移し始める
+        if (ix->oldSlots > 0) migrateOpenIndex(ix, ix->oldSlots);
+        ix->oldSlots = ix->nslots;
+        ix->oldKeys = ix->keys;
+        ix->oldIdx = ix->idx;
+        ix->moved = 0;
+        ix->nslots *= 2;
+        allocOpenSlots(ix->nslots, &ix->keys, &ix->idx);
+    }
+    putOpenSlot(ix->keys, ix->idx, ix->nslots, key, v);
+    ix->n++;
+}
 
 // ==================================================
-// パス2用 (2アイテムペア) の構造とハッシュ
+// パス1用 (単一アイテム) のハッシュ
+//   キー = アイテム。アイテムと 32bit の頻度は登録順の密な配列に置く
 // ==================================================
-struct pairNode {
-    int item1;
-    int item2;  
-    long long count;
-    struct pairNode *next;
+struct itemTable {
+    struct openIndex ix;
+    long long n, cap;
+    int *items;         // 登録されたアイテム
+    uint32_t *counts;   // その頻度
 };
-static struct pairNode *pairHash[BUCKET_SIZE];
+static struct itemTable itemHash;
 
-void initPairHash() {
-    for (int i = 0; i < BUCKET_SIZE; i++) {
-        pairHash[i] = NULL;
+// expected はアイテムの種類数の見込み
+void initItemHash(long long expected) {
+    initOpenIndex(&itemHash.ix, expected);
+    itemHash.n = 0;
+    itemHash.cap = expected > 16 ? expected : 16;
+    itemHash.items = (int*)malloc(sizeof(int) * itemHash.cap);
+    itemHash.counts = (uint32_t*)malloc(sizeof(uint32_t) * itemHash.cap);
+    if (!itemHash.items || !itemHash.counts) {
+        fprintf(stderr, "Error: malloc failed\n");
+        exit(1);
     }
 }
-int hashPair(int a, int b) {
-    if (a>b) {int t=a; a=b; b=t;}
-    long long key = (long long)a*31LL + (long long)b;
-    long long idx = key % BUCKET_SIZE;
-    if (idx<0) idx+=BUCKET_SIZE;
-    return (int)idx;
+// item の添字を返す。無ければ -1
+long long searchItem(int item) {
+    // インストルメンテーション: 回数カウント
+    searchItem_calls++;
+    // 見たスロットの数を searchItem_traversals に足す
+    return findOpenIndex(&itemHash.ix, (uint32_t)item, NULL, NULL, &searchItem_traversals);
 }
-struct pairNode* searchPair(int a, int b) {
-    searchPair_calls++;
-
-    if (a>b) {int t=a; a=b; b=t;}
-    int h = hashPair(a,b);
-    struct pairNode *p = pairHash[h];
-    while (p) {
-        searchPair_traversals++;
-        if (p->item1==a && p->item2==b) return p;
-        p = p->next;
+// 並列カウントの合算用 (c 回分まとめて加える)
+void addItemCount(int item, long long c) {
+    long long p = searchItem(item);
+    if (p < 0) {
+        if (itemHash.n >= itemHash.cap) {
+            itemHash.cap *= 2;
+            int *ti = (int*)realloc(itemHash.items, sizeof(int) * itemHash.cap);
+            uint32_t *tc = (uint32_t*)realloc(itemHash.counts, sizeof(uint32_t) * itemHash.cap);
+            if (!ti || !tc) {
+                fprintf(stderr, "Error: realloc failed\n");
+                exit(1);
+            }
+            itemHash.items = ti;
+            itemHash.counts = tc;
+        }
+        p = itemHash.n++;
+        itemHash.items[p] = item;
+        itemHash.counts[p] = 0;
+        insertOpenIndex(&itemHash.ix, (uint32_t)item, (uint32_t)p);
     }
-    return NULL;
+    if ((long long)itemHash.counts[p] + c > UINT32_MAX) {
+        fprintf(stderr, "Error: item count overflow\n");
+        exit(1);
+    }
+    itemHash.counts[p] += (uint32_t)c;
+}
+void insertOrUpdateItem(int item) {
+    addItemCount(item, 1);
 }
-struct pairNode* createPairNode(int a, int b) {
-    struct pairNode *node = (struct pairNode*)malloc(sizeof(struct pairNode));
-    if (!node) {
+void freeItemHash() {
+    freeOpenIndex(&itemHash.ix);
+    free(itemHash.items);
+    free(itemHash.counts);
+    itemHash.items = NULL;
+    itemHash.counts = NULL;
+    itemHash.n = itemHash.cap = 0;
+}
+
+
+// ==================================================
+// パスk用 (k-アイテムセット) の汎用格納庫
+//   C_k / L_k はすべてこの構造で扱う (長さごとに構造体を作らない)
+//   items[] に k 個ずつ昇順で詰めて保持し、ハッシュ表 (openIndex) には
+//   セットを uint64_t に詰めたキーと添字を置く:
+//     k=1: アイテム, k=2: (a<<32)|b, k=3 で各アイテムが 21bit に収まれば
+//     (a<<42)|(b<<21)|c。それ以外はハッシュ値なので items[] と照合する。
+//   表の大きさは作るときの期待件数 expected から決める。
+// ==================================================
+struct itemsetStore {
+    int k;              // アイテムセットの長さ
+    long long n;        // 登録数
+    long long cap;      // 確保済みの件数
+    int *items;         // n*k 個のアイテム (i番目のセットは items[i*k] から)
+    long long *counts;  // 各セットの頻度
+    struct openIndex ix;
+};
+
+// expected は登録数の見込み (0 なら小さく始めて必要に応じて広げる)
+struct itemsetStore* createItemsetStore(int k, long long expected) {
+    struct itemsetStore *s = (struct itemsetStore*)malloc(sizeof(struct itemsetStore));
+    if (!s) {
         fprintf(stderr, "Error: malloc failed\n");
         exit(1);
     }
-    if (a>b) {int t=a;a=b;b=t;}
-    node->item1 = a;
-    node->item2 = b;
-    node->count = 0;
-    node->next = NULL;
-    return node;
-}
-void insertPairCandidate(int a, int b) {
-    struct pairNode *found = searchPair(a,b);
-    if (!found) {
-        int h = hashPair(a,b);
-        struct pairNode *n = createPairNode(a,b);
-        n->next = pairHash[h];
-        pairHash[h] = n;
+    s->k = k;
+    s->n = 0;
+    s->cap = expected > 16 ? expected : 16;
+    s->items = (int*)malloc(sizeof(int) * k * s->cap);
+    s->counts = (long long*)malloc(sizeof(long long) * s->cap);
+    if (!s->items || !s->counts) {
+        fprintf(stderr, "Error: malloc failed\n");
+        exit(1);
     }
+    initOpenIndex(&s->ix, expected);
+    return s;
+}
+void freeItemsetStore(struct itemsetStore *s) {
+    if (!s) return;
+    free(s->items);
+    free(s->counts);
+    freeOpenIndex(&s->ix);
+    free(s);
 }
-void incrementPairCount(int a, int b) {
-    struct pairNode *p = searchPair(a,b);
-    if (p) {
-        p->count++;
+// set (昇順) を uint64_t のキーに詰める
+//   k=3 で詰められるときは 63bit に収まるので、ハッシュ値は最上位ビットを立てて区別する
+static inline uint64_t packItemset(const int *set, int k) {
+    if (k == 1) return (uint32_t)set[0];
+    if (k == 2) return ((uint64_t)(uint32_t)set[0] << 32) | (uint32_t)set[1];
+    if (k == 3 && (uint32_t)set[0] < (1u << 21) && (uint32_t)set[1] < (1u << 21)
+               && (uint32_t)set[2] < (1u << 21)) {
+        return ((uint64_t)set[0] << 42) | ((uint64_t)set[1] << 21) | (uint64_t)set[2];
     }
+    uint64_t h = 0x9e3779b97f4a7c15ULL;
+    for (int i = 0; i < k; i++) {
+        h = mixHash64(h ^ (uint32_t)set[i]);
+    }
+    h |= 1ULL << 63;
+    return h == OPEN_EMPTY ? h - 1 : h;
+}
+// キーがセットそのものを表すか (ハッシュ値なら items[] との照合が要る)
+static inline int isExactKey(int k, uint64_t key) {
+    return k <= 2 || (k == 3 && key < (1ULL << 63));
+}
+struct itemsetMatch {
+    const struct itemsetStore *s;
+    const int *set;
+};
+static int matchItemset(const void *ctx, uint32_t idx) {
+    const struct itemsetMatch *m = (const struct itemsetMatch*)ctx;
+    return memcmp(&m->s->items[(long long)idx * m->s->k], m->set, sizeof(int) * m->s->k) == 0;
 }
-void freePairHash() {
-    for (int i=0; i<BUCKET_SIZE; i++) {
-        struct pairNode *p = pairHash[i];
-        while(p) {
-            struct pairNode *tmp = p;
-            p = p->next;
-            free(tmp);
+// set (昇順) の添字を返す。無ければ -1 (probes に見たスロット数を足す)
+static long long findItemset(struct itemsetStore *s, const int *set, long long *probes) {
+    uint64_t key = packItemset(set, s->k);
+    if (isExactKey(s->k, key)) return findOpenIndex(&s->ix, key, NULL, NULL, probes);
+    struct itemsetMatch m = { s, set };
+    return findOpenIndex(&s->ix, key, matchItemset, &m, probes);
+}
+long long searchItemset(struct itemsetStore *s, const int *set) {
+    searchItemset_calls[s->k]++;
+    return findItemset(s, set, &searchItemset_traversals[s->k]);
+}
+// 末尾に追加する (重複していないことは呼び出し側が保証する)
+long long insertItemset(struct itemsetStore *s, const int *set, long long count) {
+    if (s->n >= s->cap) {
+        s->cap *= 2;
+        int *ti = (int*)realloc(s->items, sizeof(int) * s->k * s->cap);
+        long long *tc = (long long*)realloc(s->counts, sizeof(long long) * s->cap);
+        if (!ti || !tc) {
+            fprintf(stderr, "Error: realloc failed\n");
+            exit(1);
         }
-        pairHash[i] = NULL;
+        s->items = ti;
+        s->counts = tc;
+    }
+    if (s->n >= UINT32_MAX) {
+        fprintf(stderr, "Error: too many itemsets\n");
+        exit(1);
+    }
+    long long idx = s->n++;
+    memcpy(&s->items[idx * s->k], set, sizeof(int) * s->k);
+    s->counts[idx] = count;
+    insertOpenIndex(&s->ix, packItemset(set, s->k), (uint32_t)idx);
+    return idx;
+}
+void incrementItemsetCount(struct itemsetStore *s, const int *set) {
+    long long p = searchItemset(s, set);
+    if (p >= 0) {
+        s->counts[p]++;
     }
 }
 
-// ==================================================
-// パス3用 (3アイテム) の構造とハッシュ
-// ==================================================
-struct tripleNode {
-    int item1;
-    int item2;
-    int item3;
-    long long count;
-    struct tripleNode *next;
-};
-static struct tripleNode *tripleHash[BUCKET_SIZE];
-
-void initTripleHash() {
-    for (int i=0; i<BUCKET_SIZE; i++) {
-        tripleHash[i] = NULL;
-    }
-}
-int hashTriple(int a, int b, int c) {
-    // a<b<c
-    if (a>b){int t=a; a=b; b=t;}
-    if (b>c){int t=b; b=c; c=t;}
-    if (a>b){int t=a; a=b; b=t;}
-    long long key = (long long)a*31LL + (long long)b;
-    key = key*31LL + (long long)c;
-    long long idx = key % BUCKET_SIZE;
-    if (idx<0) idx+=BUCKET_SIZE;
-    return (int)idx;
-}
-struct tripleNode* searchTriple(int a, int b, int c) {
-    searchTriple_calls++;
-
-    if (a>b){int t=a;a=b;b=t;}
-    if (b>c){int t=b;b=c;c=t;}
-    if (a>b){int t=a;a=b;b=t;}
-    int h = hashTriple(a,b,c);
-    struct tripleNode *p = tripleHash[h];
-    while(p) {
-        searchTriple_traversals++;
-        if (p->item1==a && p->item2==b && p->item3==c) {
-            return p;
-        }
-        p = p->next;
+// 頻度 count が最小支持度 minsup を満たすか
+int isFrequentCount(long long count, long long total_t, double minsup) {
+    double sup = (double)count / (double)total_t;
+    return sup >= minsup;
+}
+
+// qsort の比較関数に渡せないので、並べ替え中のセットは静的変数で指す
+static const int *sortKeyItems;
+static int sortKeyLen;
+static int compareItemsetOrder(const void *a, const void *b) {
+    const int *x = &sortKeyItems[*(const long long*)a * sortKeyLen];
+    const int *y = &sortKeyItems[*(const long long*)b * sortKeyLen];
+    for (int i = 0; i < sortKeyLen; i++) {
+        if (x[i] != y[i]) return (x[i] > y[i]) - (x[i] < y[i]);
     }
-    return NULL;
+    return 0;
 }
-struct tripleNode* createTripleNode(int a, int b, int c) {
-    struct tripleNode *node=(struct tripleNode*)malloc(sizeof(struct tripleNode));
-    if (!node) {
+// 登録されたセットを辞書順に並べ替え、ハッシュ表を作り直す
+void sortItemsetStore(struct itemsetStore *s) {
+    long long *order = (long long*)malloc(sizeof(long long) * (s->n > 0 ? s->n : 1));
+    int *items = (int*)malloc(sizeof(int) * s->k * (s->n > 0 ? s->n : 1));
+    long long *counts = (long long*)malloc(sizeof(long long) * (s->n > 0 ? s->n : 1));
+    if (!order || !items || !counts) {
         fprintf(stderr, "Error: malloc failed\n");
         exit(1);
     }
-    if (a>b){int t=a;a=b;b=t;}
-    if (b>c){int t=b;b=c;c=t;}
-    if (a>b){int t=a;a=b;b=t;}
-    node->item1=a; 
-    node->item2=b; 
-    node->item3=c; 
-    node->count=0;
-    node->next=NULL;
-    return node;
-}
-void insertTripleCandidate(int a, int b, int c) {
-    // 既に存在しないか
-    if (!searchTriple(a,b,c)) {
-        int h = hashTriple(a,b,c);
-        struct tripleNode *n = createTripleNode(a,b,c);
-        n->next = tripleHash[h];
-        tripleHash[h] = n;
+    for (long long i = 0; i < s->n; i++) order[i] = i;
+    sortKeyItems = s->items;
+    sortKeyLen = s->k;
+    qsort(order, s->n, sizeof(long long), compareItemsetOrder);
+    for (long long i = 0; i < s->n; i++) {
+        memcpy(&items[i * s->k], &s->items[order[i] * s->k], sizeof(int) * s->k);
+        counts[i] = s->counts[order[i]];
     }
-}
-void incrementTripleCount(int a,int b,int c) {
-    struct tripleNode *p = searchTriple(a,b,c);
-    if (p) {
-        p->count++;
+    free(s->items);
+    free(s->counts);
+    s->items = items;
+    s->counts = counts;
+    s->cap = s->n > 0 ? s->n : 1;
+    clearOpenIndex(&s->ix);
+    for (long long i = 0; i < s->n; i++) {
+        insertOpenIndex(&s->ix, packItemset(&items[i * s->k], s->k), (uint32_t)i);
     }
+    free(order);
 }
-void freeTripleHash() {
-    for (int i=0; i<BUCKET_SIZE; i++) {
-        struct tripleNode *p = tripleHash[i];
-        while(p) {
-            struct tripleNode *tmp=p;
-            p=p->next;
-            free(tmp);
+
+// C_k のうち最小支持度を満たすものだけを L_k として取り出す (順序は保つ)
+struct itemsetStore* extractFrequent(struct itemsetStore *c, long long total_t) {
+    long long nfreq = 0;
+    for (long long i = 0; i < c->n; i++) {
+        if (isFrequentCount(c->counts[i], total_t, MIN_SUPPORT_RATIO)) nfreq++;
+    }
+    struct itemsetStore *l = createItemsetStore(c->k, nfreq);
+    for (long long i = 0; i < c->n; i++) {
+        if (isFrequentCount(c->counts[i], total_t, MIN_SUPPORT_RATIO)) {
+            insertItemset(l, &c->items[i * c->k], c->counts[i]);
         }
-        tripleHash[i]=NULL;
     }
+    return l;
 }
 
 // ==================================================
-// トランザクションファイルの行数(=total_transactions)を数える
+// トランザクションファイルの読み込み (mmap + SIMD による走査)
+//   ファイル全体をメモリに写像し、fgets/strtok/atoi を使わずに
+//   バッファを直接走査する。64バイトずつ「数字('-'含む)」と「改行」の
+//   ビットマスクを作り (AVX2 が使えれば AVX2、無ければスカラ)、
+//   トークンの先頭だけを訪れて整数を SWAR で8桁ずつ変換する。
+//   受け付ける形式:
+//     - 長さ付き形式  "n item1 ... itemn" (従来の .dat)
+//     - FIMI形式      "item1 ... itemn"   (長さなし)
+//     - どちらも先頭が -1 の行で終了
+//   1件読むごとに tranCallback を呼ぶ (行の長さに上限はない)
 // ==================================================
-long long countTransactions(const char *filename) {
-    FILE *fp = fopen(filename, "r");
+typedef void (*tranCallback)(const int *items, int len, void *arg);
+
+#define SCAN_DETECT_LINES 100   // 形式の自動判定に使う行数
+
+struct mappedFile {
+    const char *buf;
+    size_t len;
+#if defined(_WIN32)
+    char *heap;      // mmap が無い環境では全体を読み込む
+#endif
+};
+
+void mapFile(const char *filename, struct mappedFile *mf) {
+    mf->buf = NULL;
+    mf->len = 0;
+#if defined(_WIN32)
+    FILE *fp = fopen(filename, "rb");
     if (!fp) {
         fprintf(stderr, "Error: cannot open %s\n", filename);
         exit(1);
     }
-    long long total=0;
-    char line[1024*10];
-    while(fgets(line,sizeof(line),fp)) {
-        char *p=strtok(line," \t\r\n");
-        if(!p) continue;
-        int tlen=atoi(p);
-        if(tlen==-1) break;
-        total++;
+    fseek(fp, 0, SEEK_END);
+    long sz = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    mf->heap = (char*)malloc(sz > 0 ? sz : 1);
+    if (!mf->heap) {
+        fprintf(stderr, "Error: malloc failed\n");
+        exit(1);
     }
+    mf->len = fread(mf->heap, 1, sz, fp);
+    mf->buf = mf->heap;
     fclose(fp);
-    return total;
-}
-
-// ---------------------------
-// pass1_generateL1
-// ---------------------------
-long long pass1_generateL1(const char *transaction_file, const char *l1_file) {
-    clock_t start = clock();
-
-    initItemHash();
-
-    FILE *fp = fopen(transaction_file,"r");
-    if(!fp){
-        fprintf(stderr,"Error: cannot open %s\n", transaction_file);
+#else
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "Error: cannot open %s\n", filename);
+        exit(1);
+    }
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        fprintf(stderr, "Error: cannot stat %s\n", filename);
         exit(1);
     }
-    long long transCount=0;
-    char line[1024*10];
-    while(fgets(line,sizeof(line),fp)){
-        char *ptr=strtok(line," \t\r\n");
-        if(!ptr) continue;
-        int tlen=atoi(ptr);
-        if(tlen==-1) break;
-        for(int i=0;i<tlen;i++){
-            ptr=strtok(NULL," \t\r\n");
-            if(!ptr) break;
-            int it=atoi(ptr);
-            insertOrUpdateItem(it);
+    mf->len = (size_t)st.st_size;
+    if (mf->len > 0) {
+        void *p = mmap(NULL, mf->len, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p == MAP_FAILED) {
+            fprintf(stderr, "Error: mmap failed for %s\n", filename);
+            exit(1);
         }
-        transCount++;
+        madvise(p, mf->len, MADV_SEQUENTIAL);
+        mf->buf = (const char*)p;
     }
-    fclose(fp);
+    close(fd);
+#endif
+}
+void unmapFile(struct mappedFile *mf) {
+#if defined(_WIN32)
+    free(mf->heap);
+#else
+    if (mf->len > 0) munmap((void*)mf->buf, mf->len);
+#endif
+    mf->buf = NULL;
+    mf->len = 0;
+}
 
-    // L1.dat 書き出し
-    FILE *fout = fopen(l1_file,"w");
-    if(!fout){
-        fprintf(stderr,"Error: cannot open %s for writing\n", l1_file);
-        exit(1);
+// p[0..n) (n<=64) を分類し、数字/'-' のビットと改行のビットを返す
+static void classifyScalar(const unsigned char *p, int n, uint64_t *num, uint64_t *nl) {
+    uint64_t a = 0, b = 0;
+    for (int i = 0; i < n; i++) {
+        unsigned char ch = p[i];
+        if ((unsigned char)(ch - '0') < 10 || ch == '-') a |= 1ULL << i;
+        else if (ch == '\n') b |= 1ULL << i;
     }
-    // support >= min_sup
-    for(int i=0;i<BUCKET_SIZE;i++){
-        struct itemNode *p=itemHash[i];
-        while(p){
-            double sup=(double)p->count/(double)transCount;
-            if(sup >= MIN_SUPPORT_RATIO){
-                fprintf(fout, "%d %lld %.6f\n", p->item, p->count, sup);
-            }
-            p=p->next;
+    *num = a;
+    *nl = b;
+}
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define HAVE_AVX2_SCAN 1
+__attribute__((target("avx2")))
+static void classifyAvx2(const unsigned char *p, uint64_t *num, uint64_t *nl) {
+    const __m256i c0 = _mm256_set1_epi8('0' - 1);
+    const __m256i c9 = _mm256_set1_epi8('9' + 1);
+    const __m256i cm = _mm256_set1_epi8('-');
+    const __m256i cn = _mm256_set1_epi8('\n');
+    uint64_t a = 0, b = 0;
+    for (int h = 0; h < 2; h++) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(p + 32 * h));
+        // '0'..'9' は符号付き比較でも範囲内 (ASCII は 0x7f 以下)
+        __m256i d = _mm256_and_si256(_mm256_cmpgt_epi8(v, c0), _mm256_cmpgt_epi8(c9, v));
+        d = _mm256_or_si256(d, _mm256_cmpeq_epi8(v, cm));
+        a |= (uint64_t)(uint32_t)_mm256_movemask_epi8(d) << (32 * h);
+        b |= (uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, cn)) << (32 * h);
+    }
+    *num = a;
+    *nl = b;
+}
+#endif
+
+// p から始まる10進数を読み、読んだ桁数を *len に入れる (SWARで8桁ずつ)
+static long long parseDigits(const char *p, const char *end, int *len) {
+    long long val = 0;
+    const char *q = p;
+    while (end - q >= 8) {
+        uint64_t v;
+        memcpy(&v, q, 8);
+        // 数字でないバイトは非0になる (先頭の非数字より手前は正しく判定される)
+        uint64_t bad = ((v & 0xF0F0F0F0F0F0F0F0ULL) ^ 0x3030303030303030ULL)
+                     | (((v + 0x0606060606060606ULL) & 0xF0F0F0F0F0F0F0F0ULL) ^ 0x3030303030303030ULL);
+        int nd = bad ? (__builtin_ctzll(bad) >> 3) : 8;
+        if (nd == 0) break;
+        // 下位 nd バイトの数字を上位に寄せ、上の桁を0で埋めて8桁として変換
+        uint64_t d = (v - 0x3030303030303030ULL) & (nd == 8 ? ~0ULL : ((1ULL << (8 * nd)) - 1));
+        d <<= 8 * (8 - nd);
+        d = (d * 10) + (d >> 8);
+        d = (((d & 0x000000FF000000FFULL) * (100 + (1000000ULL << 32)))
+           + (((d >> 16) & 0x000000FF000000FFULL) * (1 + (10000ULL << 32)))) >> 32;
+        static const long long pow10[9] = {1,10,100,1000,10000,100000,1000000,10000000,100000000};
+        val = val * pow10[nd] + (long long)(uint32_t)d;
+        q += nd;
+        if (nd < 8) {
+            *len = (int)(q - p);
+            return val;
         }
     }
-    fclose(fout);
+    while (q < end && (unsigned char)(*q - '0') < 10) {
+        val = val * 10 + (*q - '0');
+        q++;
+    }
+    *len = (int)(q - p);
+    return val;
+}
 
-    clock_t end = clock();
-    pass1_time += (double)(end - start) / CLOCKS_PER_SEC;
+// 先頭 SCAN_DETECT_LINES 行で「先頭の数 = 残りのトークン数」が成り立てば長さ付き形式
+static int detectLengthPrefix(const char *buf, size_t len) {
+    const char *p = buf, *end = buf + len;
+    int lines = 0;
+    while (p < end && lines < SCAN_DETECT_LINES) {
+        long long first = 0;
+        int ntok = 0;
+        while (p < end && *p != '\n') {
+            if ((unsigned char)(*p - '0') < 10 || *p == '-') {
+                int neg = (*p == '-');
+                if (neg) p++;
+                int l;
+                long long v = parseDigits(p, end, &l);
+                p += l;
+                if (ntok == 0) first = neg ? -v : v;
+                ntok++;
+            } else {
+                p++;
+            }
+        }
+        if (p < end) p++;
+        if (ntok == 0) continue;
+        if (first == -1 && ntok == 1) break;
+        if (first != ntok - 1) return 0;
+        lines++;
+    }
+    return 1;
+}
 
-    return transCount;  
+// 長さ付き形式と判定したのに、先頭の数と残りのトークン数が合わない行
+static void lengthMismatch(long long tlen, int ntok) {
+    fprintf(stderr, "Error: a transaction starts with length %lld but has %d items "
+            "(length-prefixed format was detected from the first lines)\n", tlen, ntok - 1);
+    exit(1);
 }
 
-// ---------------------------
-// pass2_generateL2
-// ---------------------------
-long long pass2_generateL2(const char *transaction_file, const char *l1_file, long long total_t) {
-    clock_t start = clock();
+// バッファ全体を lengthPrefix の形式として走査し、1トランザクションごとに cb を呼ぶ。
+// 長さ付き形式で先頭の数と合わない行があればエラーにする。終端の -1 まで読んだら 1 を返す
+int scanTransactionsAs(const char *buf, size_t len, int lengthPrefix, tranCallback cb, void *arg) {
+#ifdef HAVE_AVX2_SCAN
+    int useAvx2 = __builtin_cpu_supports("avx2");
+#endif
+    int cap = 1024;
+    int *items = (int*)malloc(sizeof(int) * cap);
+    if (!items) {
+        fprintf(stderr, "Error: malloc failed\n");
+        exit(1);
+    }
+    int n = 0;          // 現在の行で集めたアイテム数
+    int ntok = 0;       // 現在の行のトークン数
+    long long tlen = 0; // 長さ付き形式の先頭の数
+    int done = 0;
+    uint64_t carry = 0; // 直前のブロックの最終バイトが数字だったか
+    const char *end = buf + len;
 
-    initPairHash();
+    for (size_t pos = 0; pos < len && !done; pos += 64) {
+        uint64_t num, nl;
+        const unsigned char *p = (const unsigned char*)buf + pos;
+#ifdef HAVE_AVX2_SCAN
+        if (useAvx2 && len - pos >= 64) classifyAvx2(p, &num, &nl);
+        else
+#endif
+        classifyScalar(p, (int)(len - pos < 64 ? len - pos : 64), &num, &nl);
 
-    // A) L1.dat の読み込み
-    FILE *fp_l1 = fopen(l1_file,"r");
-    if(!fp_l1){
-        fprintf(stderr,"Error: cannot open %s\n", l1_file);
-        exit(1);
+        uint64_t starts = num & ~((num << 1) | carry);
+        carry = num >> 63;
+        uint64_t events = starts | nl;
+        while (events && !done) {
+            int b = __builtin_ctzll(events);
+            events &= events - 1;
+            if ((nl >> b) & 1) {
+                // 行末: トークンがあれば1件確定
+                if (ntok > 0) {
+                    if (lengthPrefix && ntok - 1 != tlen) lengthMismatch(tlen, ntok);
+                    cb(items, n, arg);
+                }
+                n = 0;
+                ntok = 0;
+                continue;
+            }
+            const char *q = buf + pos + b;
+            int neg = (*q == '-');
+            if (neg) q++;
+            int l;
+            long long v = parseDigits(q, end, &l);
+            if (neg) v = -v;
+            if (ntok == 0 && v == -1) {
+                // 終端
+                done = 1;
+                break;
+            }
+            if (ntok == 0 && lengthPrefix) {
+                tlen = v;
+            } else if (!lengthPrefix || n < tlen) {
+                if (n >= cap) {
+                    cap *= 2;
+                    int *tmp = (int*)realloc(items, sizeof(int) * cap);
+                    if (!tmp) {
+                        fprintf(stderr, "Error: realloc failed\n");
+                        exit(1);
+                    }
+                    items = tmp;
+                }
+                items[n++] = (int)v;
+            }
+            ntok++;
+        }
     }
-    int *l1_items = (int*)malloc(sizeof(int)*200000);
-    if(!l1_items){
-        fprintf(stderr,"Error: malloc failed for l1_items\n");
+    // 最終行に改行が無い場合
+    if (!done && ntok > 0) {
+        if (lengthPrefix && ntok - 1 != tlen) lengthMismatch(tlen, ntok);
+        cb(items, n, arg);
+    }
+    free(items);
+    return done;
+}
+// バッファ全体を走査し、1トランザクションごとに cb を呼ぶ (形式は自動判定)
+void scanTransactions(const char *buf, size_t len, tranCallback cb, void *arg) {
+    scanTransactionsAs(buf, len, detectLengthPrefix(buf, len), cb, arg);
+}
+
+// ストリーム (パイプなど) から読めた分だけ受け取り、完結した行ごとに走査する。
+// 形式は最初に届いたまとまりの完結した行で判定し、後の行が合わなければエラーにする
+// (scanTransactionsAs)。終端の -1 か EOF まで cb を呼ぶ
+#define STREAM_CHUNK (1<<20)
+void streamTransactions(FILE *fp, tranCallback cb, void *arg) {
+    size_t cap = STREAM_CHUNK, len = 0;
+    char *buf = (char*)malloc(cap);
+    if (!buf) {
+        fprintf(stderr, "Error: malloc failed\n");
         exit(1);
     }
-    int l1_count=0;
-    while(!feof(fp_l1)){
-        int it;
-        long long c;
-        double sup;
-        int r=fscanf(fp_l1, "%d %lld %lf",&it,&c,&sup);
-        if(r==3){
-            l1_items[l1_count++]=it;
-        } else {
+    int lengthPrefix = -1;
+    int done = 0;
+    while (!done) {
+        if (cap - len < STREAM_CHUNK / 2) {
+            cap *= 2;
+            char *tmp = (char*)realloc(buf, cap);
+            if (!tmp) {
+                fprintf(stderr, "Error: realloc failed\n");
+                exit(1);
+            }
+            buf = tmp;
+        }
+#if defined(_WIN32)
+        long long r = (long long)fread(buf + len, 1, cap - len, fp);
+#else
+        long long r = (long long)read(fileno(fp), buf + len, cap - len);
+        if (r < 0 && errno == EINTR) continue;
+#endif
+        if (r <= 0) {
+            // EOF: 改行の無い最終行も走査する
+            if (len > 0) {
+                if (lengthPrefix < 0) lengthPrefix = detectLengthPrefix(buf, len);
+                scanTransactionsAs(buf, len, lengthPrefix, cb, arg);
+            }
             break;
         }
+        len += (size_t)r;
+        size_t upto = len;
+        while (upto > 0 && buf[upto - 1] != '\n') upto--;
+        if (upto == 0) continue;
+        if (lengthPrefix < 0) lengthPrefix = detectLengthPrefix(buf, upto);
+        done = scanTransactionsAs(buf, upto, lengthPrefix, cb, arg);
+        memmove(buf, buf + upto, len - upto);
+        len -= upto;
     }
-    fclose(fp_l1);
+    free(buf);
+}
+
+// ==================================================
+// トランザクションDB (ファイルを1回だけ読み込み、CSR形式でメモリに保持)
+//   i番目のトランザクションは items[offsets[i] .. offsets[i+1]) で、
+//   各トランザクション内のアイテムは昇順に並べ替えておく。
+//   トランザクション数の数え上げと全パスはこの配列を走査する。
+// ==================================================
+struct tranDB {
+    long long n;          // トランザクション数
+    long long *offsets;   // n+1 個
+    int *items;           // 全トランザクションのアイテムを連続して格納
+    long long nitems;     // items の使用数
+    int maxlen;           // 最長トランザクションの長さ
+    long long bytes;      // 読んだファイルの先頭からのバイト数
+    long long capTrans;
+    long long capItems;
+};
 
-    // B) C2 生成
-    for(int i=0;i<l1_count;i++){
-        for(int j=i+1;j<l1_count;j++){
-            insertPairCandidate(l1_items[i], l1_items[j]);
+static int compareInt(const void *a, const void *b) {
+    int x = *(const int*)a, y = *(const int*)b;
+    return (x > y) - (x < y);
+}
+// トランザクション1件ぶんの昇順ソート (短いものは挿入ソート)
+static void sortItems(int *a, int n) {
+    if (n > 32) {
+        qsort(a, n, sizeof(int), compareInt);
+        return;
+    }
+    for (int i = 1; i < n; i++) {
+        int v = a[i], j = i - 1;
+        while (j >= 0 && a[j] > v) {
+            a[j+1] = a[j];
+            j--;
         }
+        a[j+1] = v;
     }
-    free(l1_items);
+}
 
-    // C) トランザクション再スキャン, ペア頻度カウント
-    FILE *fp = fopen(transaction_file,"r");
-    if(!fp){
-        fprintf(stderr,"Error: cannot open %s\n", transaction_file);
-        exit(1);
+// scanTransactions から1件ずつ受け取り、CSR の末尾に追加する
+static void appendTransaction(const int *items, int len, void *arg) {
+    struct tranDB *db = (struct tranDB*)arg;
+    if (db->nitems + len > db->capItems) {
+        while (db->nitems + len > db->capItems) db->capItems *= 2;
+        int *tmp = (int*)realloc(db->items, sizeof(int) * db->capItems);
+        if (!tmp) {
+            fprintf(stderr, "Error: realloc failed\n");
+            exit(1);
+        }
+        db->items = tmp;
     }
-    while(1){
-        char line[1024*10];
-        if(!fgets(line,sizeof(line),fp)) break;
-        char *ptr=strtok(line," \t\r\n");
-        if(!ptr) continue;
-        int tlen=atoi(ptr);
-        if(tlen==-1) break;
-        static int items[MAX_ITEMS_IN_TRANSACTION];
-        int ac=0;
-        for(int i=0;i<tlen;i++){
-            ptr=strtok(NULL," \t\r\n");
-            if(!ptr) break;
-            items[ac++]=atoi(ptr);
-            if(ac>=MAX_ITEMS_IN_TRANSACTION) break;
+    long long begin = db->nitems;
+    memcpy(&db->items[begin], items, sizeof(int) * len);
+
+    // 昇順に並べて重複を除く
+    sortItems(&db->items[begin], len);
+    int m = 0;
+    for (int i = 0; i < len; i++) {
+        if (m == 0 || db->items[begin + m - 1] != db->items[begin + i]) {
+            db->items[begin + m++] = db->items[begin + i];
         }
-        // ペアを列挙
-        for(int i=0;i<ac;i++){
-            for(int j=i+1;j<ac;j++){
-                incrementPairCount(items[i], items[j]);
-            }
+    }
+    db->nitems = begin + m;
+    if (m > db->maxlen) db->maxlen = m;
+
+    if (db->n + 1 >= db->capTrans) {
+        db->capTrans *= 2;
+        long long *tmp = (long long*)realloc(db->offsets, sizeof(long long) * db->capTrans);
+        if (!tmp) {
+            fprintf(stderr, "Error: realloc failed\n");
+            exit(1);
         }
+        db->offsets = tmp;
     }
-    fclose(fp);
+    db->n++;
+    db->offsets[db->n] = db->nitems;
+}
 
-    // D) L2.dat 出力
-    FILE *fout = fopen("L2.dat","w");
-    if(!fout){
-        fprintf(stderr,"Error: cannot open L2.dat for writing\n");
+// filename の先頭 limit バイトだけを読む (limit < 0 なら全体)。
+// ファイルが limit より短いか、limit の位置が行の途中ならエラー (読んだ後に書き換えられている)
+struct tranDB* loadTransactionsPrefix(const char *filename, long long limit) {
+    struct tranDB *db = (struct tranDB*)malloc(sizeof(struct tranDB));
+    if (!db) {
+        fprintf(stderr, "Error: malloc failed\n");
         exit(1);
     }
-    long long found_pairs=0;
-    for(int i=0;i<BUCKET_SIZE;i++){
-        struct pairNode *p=pairHash[i];
-        while(p){
-            double sup=(double)p->count/(double)total_t;
-            if(sup >= MIN_SUPPORT_RATIO){
-                fprintf(fout, "%d %d %lld %.6f\n", p->item1,p->item2,p->count,sup);
-                found_pairs++;
-            }
-            p=p->next;
-        }
+    db->n = 0;
+    db->nitems = 0;
+    db->maxlen = 0;
+    db->bytes = 0;
+    db->capTrans = 1024;
+    db->capItems = 1024 * 16;
+    db->offsets = (long long*)malloc(sizeof(long long) * db->capTrans);
+    db->items = (int*)malloc(sizeof(int) * db->capItems);
+    if (!db->offsets || !db->items) {
+        fprintf(stderr, "Error: malloc failed\n");
+        exit(1);
     }
-    fclose(fout);
+    db->offsets[0] = 0;
 
-    clock_t end = clock();
-    pass2_time += (double)(end - start) / CLOCKS_PER_SEC;
+    struct mappedFile mf;
+    mapFile(filename, &mf);
+    size_t len = mf.len;
+    if (limit >= 0) {
+        if ((size_t)limit > mf.len || (limit > 0 && (size_t)limit < mf.len && mf.buf[limit - 1] != '\n')) {
+            fprintf(stderr, "Error: %s has changed since it was read (expected its first %lld bytes "
+                    "to be unchanged, file now has %lld bytes)\n", filename, limit, (long long)mf.len);
+            exit(1);
+        }
+        len = (size_t)limit;
+    }
+    scanTransactions(mf.buf, len, appendTransaction, db);
+    db->bytes = (long long)len;
+    unmapFile(&mf);
+    return db;
+}
+struct tranDB* loadTransactions(const char *filename) {
+    return loadTransactionsPrefix(filename, -1);
+}
+void freeTransactions(struct tranDB *db) {
+    if (!db) return;
+    free(db->offsets);
+    free(db->items);
+    free(db);
+}
 
-    return found_pairs;
+// トランザクション数 (=total_transactions)
+long long countTransactions(struct tranDB *db) {
+    return db->n;
 }
 
-// ---------------------------
-// pass3_generateL3
-// ---------------------------
-struct pairInfo {
-    int a;
-    int b;
-    long long count;
-    double sup;
-};
 
-static struct pairCheck {
-    int a;
-    int b;
-    struct pairCheck *next;
-} *pairCheckHash[BUCKET_SIZE];
-
-void initPairCheck() {
-    for (int i=0;i<BUCKET_SIZE;i++){
-        pairCheckHash[i]=NULL;
-    }
-}
-int hashPairCheck(int a,int b){
-    if(a>b){int t=a;a=b;b=t;}
-    long long key=(long long)a*31LL + (long long)b;
-    long long idx = key % BUCKET_SIZE;
-    if(idx<0) idx+=BUCKET_SIZE;
-    return (int)idx;
-}
-void insertPairCheck(int a,int b){
-    if(a>b){int t=a;a=b;b=t;}
-    int h=hashPairCheck(a,b);
-    struct pairCheck *pc=(struct pairCheck*)malloc(sizeof(struct pairCheck));
-    pc->a=a; 
-    pc->b=b; 
-    pc->next=pairCheckHash[h];
-    pairCheckHash[h]=pc;
-}
-int isFrequentPairCheck(int a,int b){
-    if(a>b){int t=a;a=b;b=t;}
-    int h=hashPairCheck(a,b);
-    struct pairCheck *p=pairCheckHash[h];
-    while(p){
-        if(p->a==a && p->b==b) return 1;
-        p=p->next;
+// ==================================================
+// 並列カウント (--threads)
+//   トランザクションDBを連続した区間に分け、各スレッドは自分のシャードに
+//   数える。区間はトランザクション数ではなく推定コスト C(|t|,k) の和が
+//   均等になるように切るので、巨大なトランザクションが偏っても遊ぶ
+//   スレッドが出にくい。シャードはスレッド番号順に合算する (結果は決定的)。
+// ==================================================
+
+// C(len, k) (大きくなるので double で近似)
+static double combCost(int len, int k) {
+    if (len < k) return 0.0;
+    double r = 1.0;
+    for (int i = 0; i < k; i++) {
+        r = r * (double)(len - i) / (double)(i + 1);
     }
-    return 0;
+    return r;
 }
-void freePairCheckHash(){
-    for(int i=0;i<BUCKET_SIZE;i++){
-        struct pairCheck *p=pairCheckHash[i];
-        while(p){
-            struct pairCheck *tmp=p;
-            p=p->next;
-            free(tmp);
+// [0, db->n) を nth 個の区間 [bounds[i], bounds[i+1]) に分ける
+void splitByCost(struct tranDB *db, int k, int nth, long long *bounds) {
+    double total = 0.0;
+    for (long long t = 0; t < db->n; t++) {
+        total += combCost((int)(db->offsets[t+1] - db->offsets[t]), k);
+    }
+    bounds[0] = 0;
+    double acc = 0.0;
+    long long t = 0;
+    for (int i = 1; i < nth; i++) {
+        double target = total * i / nth;
+        while (t < db->n && acc < target) {
+            acc += combCost((int)(db->offsets[t+1] - db->offsets[t]), k);
+            t++;
         }
-        pairCheckHash[i]=NULL;
+        bounds[i] = t;
     }
+    bounds[nth] = db->n;
 }
-
-long long pass3_generateL3(const char *transaction_file, long long total_t) {
-    clock_t start = clock();
-
-    initTripleHash();
-
-    // A) L2.dat 読み込み → pair配列 と pairCheckハッシュ
-    initPairCheck();
-    FILE *fp = fopen("L2.dat","r");
-    if(!fp){
-        fprintf(stderr,"Error: cannot open L2.dat\n");
+// fn(&args[i]) を nth 個のスレッドで実行して終了を待つ (nth==1 ならそのまま呼ぶ)
+void runWorkers(void *(*fn)(void*), void *args, size_t argSize, int nth) {
+    if (nth <= 1) {
+        fn(args);
+        return;
+    }
+    pthread_t *th = (pthread_t*)malloc(sizeof(pthread_t) * nth);
+    if (!th) {
+        fprintf(stderr, "Error: malloc failed\n");
         exit(1);
     }
-    int capacity=100000;
-    struct pairInfo *pairs=(struct pairInfo*)malloc(sizeof(struct pairInfo)*capacity);
-    if(!pairs){
-        fprintf(stderr,"Error: malloc failed for pairs\n");
+    for (int i = 0; i < nth; i++) {
+        if (pthread_create(&th[i], NULL, fn, (char*)args + argSize * i) != 0) {
+            fprintf(stderr, "Error: pthread_create failed\n");
+            exit(1);
+        }
+    }
+    for (int i = 0; i < nth; i++) {
+        pthread_join(th[i], NULL);
+    }
+    free(th);
+}
+
+// パス1のスレッド: 区間内のアイテムを並べ替えて (item, count) の列にする
+struct pass1Worker {
+    struct tranDB *db;
+    long long begin, end;
+    int *items;           // 出力: 昇順のアイテム
+    long long *counts;    // 出力: その頻度
+    long long n;
+};
+static void* pass1Thread(void *arg) {
+    struct pass1Worker *w = (struct pass1Worker*)arg;
+    long long from = w->db->offsets[w->begin], to = w->db->offsets[w->end];
+    long long m = to - from;
+    w->items = (int*)malloc(sizeof(int) * (m > 0 ? m : 1));
+    w->counts = (long long*)malloc(sizeof(long long) * (m > 0 ? m : 1));
+    if (!w->items || !w->counts) {
+        fprintf(stderr, "Error: malloc failed\n");
         exit(1);
     }
-    int pair_count=0;
-    while(!feof(fp)){
-        int a,b;
-        long long c;
-        double sup;
-        int r=fscanf(fp,"%d %d %lld %lf",&a,&b,&c,&sup);
-        if(r==4){
-            insertPairCheck(a,b);
-            if(pair_count>=capacity){
-                capacity*=2;
-                struct pairInfo *tmp=(struct pairInfo*)realloc(pairs,sizeof(struct pairInfo)*capacity);
-                if(!tmp){
-                    fprintf(stderr,"Error: realloc failed\n");
-                    exit(1);
-                }
-                pairs=tmp;
-            }
-            pairs[pair_count].a=a;
-            pairs[pair_count].b=b;
-            pairs[pair_count].count=c;
-            pairs[pair_count].sup=sup;
-            pair_count++;
+    memcpy(w->items, &w->db->items[from], sizeof(int) * m);
+    qsort(w->items, m, sizeof(int), compareInt);
+    w->n = 0;
+    for (long long i = 0; i < m; i++) {
+        if (w->n > 0 && w->items[w->n - 1] == w->items[i]) {
+            w->counts[w->n - 1]++;
         } else {
-            break;
+            w->items[w->n] = w->items[i];
+            w->counts[w->n] = 1;
+            w->n++;
         }
     }
-    fclose(fp);
+    return NULL;
+}
 
-    // B) C3生成
-    for(int i=0;i<pair_count;i++){
-        int a1=pairs[i].a;
-        int a2=pairs[i].b;
-        for(int j=i+1;j<pair_count;j++){
-            int b1=pairs[j].a;
-            int b2=pairs[j].b;
-            // 結合条件: a1==b1 => (a1,a2,b2)
-            if(a1==b1){
-                if(a2!=b2 && isFrequentPairCheck(a2,b2)){
-                    insertTripleCandidate(a1,a2,b2);
-                }
-            }
-        }
+// ==================================================
+// アイテムIDの付け替え (パス1の直後)
+//   頻出アイテムに頻度の高い順で 0,1,2,... の密なIDを振り、
+//   トランザクションDBもそのIDに書き換える (非頻出アイテムは捨てる)。
+//   以降のパス・候補・ルール抽出は密なIDで動き、元のIDに戻すのは
+//   ファイル/画面に出力するときだけ。
+// ==================================================
+#define REMAP_DIRECT_MAX (1<<24)   // 元のIDがこれ未満なら配列で直接引く
+
+static int *origItemId = NULL;     // 密なID → 元のID
+static int numDenseItems = 0;
+
+struct remapEntry {
+    int item;
+    long long count;
+};
+// 頻度の降順、同じ頻度なら元のIDの昇順
+static int compareRemapEntry(const void *a, const void *b) {
+    const struct remapEntry *x = (const struct remapEntry*)a;
+    const struct remapEntry *y = (const struct remapEntry*)b;
+    if (x->count != y->count) return (x->count < y->count) - (x->count > y->count);
+    return (x->item > y->item) - (x->item < y->item);
+}
+static int compareRemapById(const void *a, const void *b) {
+    int x = ((const struct remapEntry*)a)->item, y = ((const struct remapEntry*)b)->item;
+    return (x > y) - (x < y);
+}
+// 密なIDの列 set[0..k) を元のIDに戻し、昇順に並べて out に入れる
+void toOrigItems(const int *set, int k, int *out) {
+    for (int i = 0; i < k; i++) {
+        out[i] = origItemId[set[i]];
     }
-    free(pairs);
+    sortItems(out, k);
+}
 
-    // C) トランザクション再スキャン → triple count
-    FILE *fp2 = fopen(transaction_file,"r");
-    if(!fp2){
-        fprintf(stderr,"Error: cannot open %s\n", transaction_file);
-        exit(1);
+// DBのアイテムを今の密なID (origItemId) に書き換える。頻出でないアイテムは捨てる
+void remapTransactions(struct tranDB *db) {
+    int n = numDenseItems;
+    int minId = 0, maxId = -1;
+    for (int i = 0; i < n; i++) {
+        if (i == 0 || origItemId[i] < minId) minId = origItemId[i];
+        if (i == 0 || origItemId[i] > maxId) maxId = origItemId[i];
     }
-    while(1){
-        char line[1024*10];
-        if(!fgets(line,sizeof(line),fp2)) break;
-        char *ptr=strtok(line," \t\r\n");
-        if(!ptr) continue;
-        int tlen=atoi(ptr);
-        if(tlen==-1) break;
-        static int items[MAX_ITEMS_IN_TRANSACTION];
-        int ac=0;
-        for(int i=0;i<tlen;i++){
-            ptr=strtok(NULL," \t\r\n");
-            if(!ptr) break;
-            items[ac++]=atoi(ptr);
-            if(ac>=MAX_ITEMS_IN_TRANSACTION) break;
+
+    // 元のID → 密なID の表 (IDが小さければ直接引く、大きければ二分探索)
+    int *direct = NULL;
+    struct remapEntry *byId = NULL;
+    if (minId >= 0 && maxId < REMAP_DIRECT_MAX) {
+        direct = (int*)malloc(sizeof(int) * (maxId + 1 > 0 ? maxId + 1 : 1));
+        if (!direct) {
+            fprintf(stderr, "Error: malloc failed\n");
+            exit(1);
         }
-        for(int i=0;i<ac;i++){
-            for(int j=i+1;j<ac;j++){
-                for(int k=j+1;k<ac;k++){
-                    incrementTripleCount(items[i],items[j],items[k]);
-                }
-            }
+        for (int i = 0; i <= maxId; i++) direct[i] = -1;
+        for (int i = 0; i < n; i++) direct[origItemId[i]] = i;
+    } else {
+        // count 欄に密なIDを入れて元のIDで並べる
+        byId = (struct remapEntry*)malloc(sizeof(struct remapEntry) * (n > 0 ? n : 1));
+        if (!byId) {
+            fprintf(stderr, "Error: malloc failed\n");
+            exit(1);
         }
+        for (int i = 0; i < n; i++) {
+            byId[i].item = origItemId[i];
+            byId[i].count = i;
+        }
+        qsort(byId, n, sizeof(struct remapEntry), compareRemapById);
     }
-    fclose(fp2);
 
-    // D) L3.dat 出力
-    FILE *fout=fopen("L3.dat","w");
-    if(!fout){
-        fprintf(stderr,"Error: cannot open L3.dat for writing\n");
-        exit(1);
-    }
-    long long found_triples=0;
-    for(int i=0;i<BUCKET_SIZE;i++){
-        struct tripleNode *p=tripleHash[i];
-        while(p){
-            double sup=(double)p->count/(double)total_t;
-            if(sup >= MIN_SUPPORT_RATIO){
-                fprintf(fout, "%d %d %d %lld %.6f\n",
-                    p->item1,p->item2,p->item3, p->count, sup);
-                found_triples++;
+    // DBを書き換える (その場で詰め直す)
+    long long w = 0;
+    int maxlen = 0;
+    for (long long t = 0; t < db->n; t++) {
+        long long begin = w;
+        for (long long i = db->offsets[t]; i < db->offsets[t+1]; i++) {
+            int it = db->items[i];
+            int d = -1;
+            if (direct) {
+                if (it >= 0 && it <= maxId) d = direct[it];
+            } else {
+                struct remapEntry key = { it, 0 };
+                struct remapEntry *e = (struct remapEntry*)bsearch(&key, byId, n, sizeof(struct remapEntry), compareRemapById);
+                if (e) d = (int)e->count;
             }
-            p=p->next;
+            if (d >= 0) db->items[w++] = d;
         }
+        db->offsets[t] = begin;
+        int len = (int)(w - begin);
+        sortItems(&db->items[begin], len);
+        if (len > maxlen) maxlen = len;
     }
-    fclose(fout);
+    db->offsets[db->n] = w;
+    db->nitems = w;
+    db->maxlen = maxlen;
 
-    freePairCheckHash();
+    free(direct);
+    free(byId);
+}
 
-    clock_t end = clock();
-    pass3_time += (double)(end - start) / CLOCKS_PER_SEC;
+// 頻出アイテム freq[0..n) に頻度の降順で密なIDを振り、密なIDの L1 を返す
+struct itemsetStore* assignDenseIds(struct remapEntry *freq, int n) {
+    qsort(freq, n, sizeof(struct remapEntry), compareRemapEntry);
 
-    return found_triples;
+    free(origItemId);
+    origItemId = (int*)malloc(sizeof(int) * (n > 0 ? n : 1));
+    if (!origItemId) {
+        fprintf(stderr, "Error: malloc failed\n");
+        exit(1);
+    }
+    numDenseItems = n;
+    struct itemsetStore *l1 = createItemsetStore(1, n);
+    for (int i = 0; i < n; i++) {
+        origItemId[i] = freq[i].item;
+        insertItemset(l1, &i, freq[i].count);
+    }
+    return l1;
+}
+// 頻出アイテム freq[0..n) に密なIDを振り、DBを書き換えて密なIDの L1 を返す
+struct itemsetStore* remapItems(struct tranDB *db, struct remapEntry *freq, int n) {
+    struct itemsetStore *l1 = assignDenseIds(freq, n);
+    remapTransactions(db);
+    return l1;
 }
 
-// --------------------------------------------------
-// 相関ルール抽出
-// --------------------------------------------------
+// ==================================================
+// 出力バッファ (Lk.dat / ルール)
+//   fprintf の書式解析と stdio のロックを1行ごとに払わないように、
+//   大きなバッファに整数・固定小数点を自前で書き込み、まとめて書き出す。
+//   --output direct なら stdio を通さず write(2) / writev(2) で書く。
+// ==================================================
+#define OUT_BUFFER_SIZE (1<<20)
+#define OUTPUT_STDIO  0
+#define OUTPUT_DIRECT 1
+static int OUTPUT_MODE = OUTPUT_STDIO;
+
+struct outBuf {
+    char *buf;
+    size_t len, cap;
+    FILE *fp;                 // 書き出し先
+    pthread_mutex_t *lock;    // 複数のバッファが同じ fp に書くときのロック (無ければ NULL)
+    int autoFlush;            // 0 ならいっぱいになっても書かずに広げる (あとで順に書くため)
+};
+
+// p[0..n) を fp に書く (direct なら stdio に残っている分を先に出してから write する)
+static void writeBytes(FILE *fp, const char *p, size_t n) {
+#if !defined(_WIN32)
+    if (OUTPUT_MODE == OUTPUT_DIRECT) {
+        fflush(fp);
+        int fd = fileno(fp);
+        while (n > 0) {
+            ssize_t r = write(fd, p, n);
+            if (r < 0 && errno == EINTR) continue;
+            if (r <= 0) {
+                fprintf(stderr, "Error: write failed\n");
+                exit(1);
+            }
+            p += r;
+            n -= (size_t)r;
+        }
+        return;
+    }
+#endif
+    if (n > 0 && fwrite(p, 1, n, fp) != n) {
+        fprintf(stderr, "Error: write failed\n");
+        exit(1);
+    }
+}
+void outInit(struct outBuf *o, FILE *fp, pthread_mutex_t *lock, int autoFlush) {
+    o->cap = OUT_BUFFER_SIZE;
+    o->len = 0;
+    o->buf = (char*)malloc(o->cap);
+    if (!o->buf) {
+        fprintf(stderr, "Error: malloc failed\n");
+        exit(1);
+    }
+    o->fp = fp;
+    o->lock = lock;
+    o->autoFlush = autoFlush;
+}
+void outFlush(struct outBuf *o) {
+    if (o->len == 0) return;
+    if (o->lock) pthread_mutex_lock(o->lock);
+    writeBytes(o->fp, o->buf, o->len);
+    if (o->lock) pthread_mutex_unlock(o->lock);
+    o->len = 0;
+}
+void outFree(struct outBuf *o) {
+    outFlush(o);
+    free(o->buf);
+    o->buf = NULL;
+    o->cap = 0;
+}
+// n バイト書ける場所を用意する
+static inline void outReserve(struct outBuf *o, size_t n) {
+    if (o->len + n <= o->cap) return;
+    if (o->autoFlush) {
+        outFlush(o);
+        if (n <= o->cap) return;
+    }
+    size_t cap = o->cap * 2;
+    while (cap < o->len + n) cap *= 2;
+    char *t = (char*)realloc(o->buf, cap);
+    if (!t) {
+        fprintf(stderr, "Error: realloc failed\n");
+        exit(1);
+    }
+    o->buf = t;
+    o->cap = cap;
+}
+static inline void outChar(struct outBuf *o, char c) {
+    outReserve(o, 1);
+    o->buf[o->len++] = c;
+}
+static inline void outStr(struct outBuf *o, const char *s) {
+    size_t n = strlen(s);
+    outReserve(o, n);
+    memcpy(o->buf + o->len, s, n);
+    o->len += n;
+}
+static inline void outInt(struct outBuf *o, long long v) {
+    char tmp[24];
+    int n = 0;
+    unsigned long long u = v < 0 ? 0ULL - (unsigned long long)v : (unsigned long long)v;
+    do {
+        tmp[n++] = (char)('0' + u % 10);
+        u /= 10;
+    } while (u > 0);
+    if (v < 0) tmp[n++] = '-';
+    outReserve(o, n);
+    while (n > 0) o->buf[o->len++] = tmp[--n];
+}
+// x を小数点以下 digits 桁 (<= 9) で書く。printf("%.*f") と同じく、double の
+// 正確な値を最近接偶数に丸める (x = m*2^e を 128ビット整数で 10^digits 倍する)
+void outFixed(struct outBuf *o, double x, int digits) {
+    static const unsigned long long pow10[10] = {
+        1ULL, 10ULL, 100ULL, 1000ULL, 10000ULL, 100000ULL,
+        1000000ULL, 10000000ULL, 100000000ULL, 1000000000ULL
+    };
+    uint64_t bits;
+    memcpy(&bits, &x, sizeof(bits));
+    int ex = (int)((bits >> 52) & 0x7ff);
+    uint64_t m = bits & ((1ULL << 52) - 1);
+    int sh = ex == 0 ? 1074 : 1075 - ex;   // x = m * 2^-sh
+    if (ex != 0) m |= 1ULL << 52;
+    if ((bits >> 63) || ex == 0x7ff || sh <= 0 || digits < 0 || digits > 9) {
+        // 負の値・大きな値・inf/nan は普通に書く (頻度の比では起きない)
+        char tmp[64];
+        int n = snprintf(tmp, sizeof(tmp), "%.*f", digits, x);
+        outReserve(o, n);
+        memcpy(o->buf + o->len, tmp, n);
+        o->len += n;
+        return;
+    }
+    unsigned long long q = 0;
+    if (sh < 128) {
+        // m*10^digits < 2^83 なので 128ビットに収まる
+        unsigned __int128 prod = (unsigned __int128)m * pow10[digits];
+        unsigned __int128 rem = prod & (((unsigned __int128)1 << sh) - 1);
+        unsigned __int128 half = (unsigned __int128)1 << (sh - 1);
+        q = (unsigned long long)(prod >> sh);
+        if (rem > half || (rem == half && (q & 1))) q++;
+    }
+    // sh >= 128 なら x*10^digits < 2^-45 なので 0
+    outInt(o, (long long)(q / pow10[digits]));
+    if (digits == 0) return;
+    outReserve(o, digits + 1);
+    o->buf[o->len++] = '.';
+    unsigned long long f = q % pow10[digits];
+    for (int d = digits - 1; d >= 0; d--) {
+        o->buf[o->len + d] = (char)('0' + f % 10);
+        f /= 10;
+    }
+    o->len += digits;
+}
+// 複数のバッファを順に fp に書く (direct なら writev でまとめて1回で渡す)
+void outWriteAll(struct outBuf **bufs, int n, FILE *fp) {
+#if !defined(_WIN32)
+    if (OUTPUT_MODE == OUTPUT_DIRECT) {
+        fflush(fp);
+        int fd = fileno(fp);
+        struct iovec iov[64];
+        int i = 0;
+        while (i < n) {
+            int cnt = 0;
+            for (; i < n && cnt < 64; i++) {
+                if (bufs[i]->len == 0) continue;
+                iov[cnt].iov_base = bufs[i]->buf;
+                iov[cnt].iov_len = bufs[i]->len;
+                cnt++;
+            }
+            struct iovec *v = iov;
+            while (cnt > 0) {
+                ssize_t r = writev(fd, v, cnt);
+                if (r < 0 && errno == EINTR) continue;
+                if (r <= 0) {
+                    fprintf(stderr, "Error: write failed\n");
+                    exit(1);
+                }
+                // 途中まで書けたときは残りから続ける
+                while (cnt > 0 && (size_t)r >= v->iov_len) {
+                    r -= (ssize_t)v->iov_len;
+                    v++;
+                    cnt--;
+                }
+                if (cnt > 0) {
+                    v->iov_base = (char*)v->iov_base + r;
+                    v->iov_len -= (size_t)r;
+                }
+            }
+        }
+        for (i = 0; i < n; i++) bufs[i]->len = 0;
+        return;
+    }
+#endif
+    for (int i = 0; i < n; i++) {
+        writeBytes(fp, bufs[i]->buf, bufs[i]->len);
+        bufs[i]->len = 0;
+    }
+}
+
+// L_k を "item1 ... itemk count support" 形式で書き出す (アイテムは元のID)
+void writeItemsetFile(const char *filename, struct itemsetStore *l, long long total_t) {
+    FILE *fout = fopen(filename, "w");
+    if (!fout) {
+        fprintf(stderr, "Error: cannot open %s for writing\n", filename);
+        exit(1);
+    }
+    struct outBuf o;
+    outInit(&o, fout, NULL, 1);
+    int orig[MAX_ITEMSET_LEN];
+    for (long long i = 0; i < l->n; i++) {
+        // 密なIDを元のIDに戻して出力する
+        toOrigItems(&l->items[i * l->k], l->k, orig);
+        for (int j = 0; j < l->k; j++) {
+            outInt(&o, orig[j]);
+            outChar(&o, ' ');
+        }
+        outInt(&o, l->counts[i]);
+        outChar(&o, ' ');
+        outFixed(&o, (double)l->counts[i] / (double)total_t, 6);
+        outChar(&o, '\n');
+    }
+    outFree(&o);
+    fclose(fout);
+}
+
+// ---------------------------
+// Lk ファイルのバイナリ形式 (--lformat binary, Lk.bin)
+//   [ヘッダ 32バイト][アイテム n*k 個 (int32)][頻度 n 個 (int64, 8バイト境界)]
+//   レコードは元のIDで辞書順に並べる (読む側は二分探索できる)。
+//   支持度は頻度/総トランザクション数で求まるので持たない (丸めが起きない)。
+//   中身を見るときは ldump.c でテキストに直す。
+// ---------------------------
+#define LFILE_MAGIC "KDLKBIN1"
+#define LFORMAT_TEXT   0   // Lk.dat ("item1 ... itemk count support")
+#define LFORMAT_BINARY 1   // Lk.bin
+#define LFORMAT_NONE   2   // 書き出さない (ルール抽出はメモリ上の結果を使う)
+static int LFILE_FORMAT = LFORMAT_TEXT;
+
+struct lfileHeader {
+    char magic[8];
+    int32_t k;
+    int32_t flags;      // 予約 (0)
+    int64_t n;          // レコード数
+    int64_t total_t;    // 総トランザクション数
+};
+// 頻度の列の位置 (アイテムの直後を 8バイト境界にそろえる)
+static size_t lfileCountsOffset(long long n, int k) {
+    size_t off = sizeof(struct lfileHeader) + sizeof(int32_t) * (size_t)n * (size_t)k;
+    return (off + 7) & ~(size_t)7;
+}
+void writeItemsetBinary(const char *filename, struct itemsetStore *l, long long total_t) {
+    long long n = l->n;
+    int k = l->k;
+    int *orig = (int*)malloc(sizeof(int) * k * (n > 0 ? n : 1));
+    long long *order = (long long*)malloc(sizeof(long long) * (n > 0 ? n : 1));
+    if (!orig || !order) {
+        fprintf(stderr, "Error: malloc failed\n");
+        exit(1);
+    }
+    for (long long i = 0; i < n; i++) {
+        toOrigItems(&l->items[i * k], k, &orig[i * k]);
+        order[i] = i;
+    }
+    sortKeyItems = orig;
+    sortKeyLen = k;
+    qsort(order, n, sizeof(long long), compareItemsetOrder);
+
+    FILE *fout = fopen(filename, "wb");
+    if (!fout) {
+        fprintf(stderr, "Error: cannot open %s for writing\n", filename);
+        exit(1);
+    }
+    struct lfileHeader h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, LFILE_MAGIC, sizeof(h.magic));
+    h.k = k;
+    h.n = n;
+    h.total_t = total_t;
+    int *items = (int*)malloc(sizeof(int) * k * (n > 0 ? n : 1));
+    int64_t *counts = (int64_t*)malloc(sizeof(int64_t) * (n > 0 ? n : 1));
+    if (!items || !counts) {
+        fprintf(stderr, "Error: malloc failed\n");
+        exit(1);
+    }
+    for (long long i = 0; i < n; i++) {
+        memcpy(&items[i * k], &orig[order[i] * k], sizeof(int) * k);
+        counts[i] = l->counts[order[i]];
+    }
+    size_t pad = lfileCountsOffset(n, k) - sizeof(h) - sizeof(int) * (size_t)n * (size_t)k;
+    static const char zeros[8] = {0};
+    if (fwrite(&h, sizeof(h), 1, fout) != 1 ||
+        fwrite(items, sizeof(int), (size_t)n * k, fout) != (size_t)n * k ||
+        fwrite(zeros, 1, pad, fout) != pad ||
+        fwrite(counts, sizeof(int64_t), (size_t)n, fout) != (size_t)n) {
+        fprintf(stderr, "Error: write failed for %s\n", filename);
+        exit(1);
+    }
+    fclose(fout);
+    free(items);
+    free(counts);
+    free(orig);
+    free(order);
+}
+
+// L_k を --lformat の形式で Lk.dat / Lk.bin に書き出す
+void levelFileName(int k, char *buf, size_t size) {
+    if (LFILE_FORMAT == LFORMAT_NONE) snprintf(buf, size, "L%d (memory)", k);
+    else snprintf(buf, size, LFILE_FORMAT == LFORMAT_BINARY ? "L%d.bin" : "L%d.dat", k);
+}
+void writeLevelFile(struct itemsetStore *l, long long total_t) {
+    if (LFILE_FORMAT == LFORMAT_NONE) return;
+    char filename[64];
+    levelFileName(l->k, filename, sizeof(filename));
+    if (LFILE_FORMAT == LFORMAT_BINARY) writeItemsetBinary(filename, l, total_t);
+    else writeItemsetFile(filename, l, total_t);
+}
+
+// ==================================================
+// トランザクションの刈り込み (各パスの後)
+//   L_k が決まったら、(k+1)-頻出アイテムセットに入り得ないアイテムを除き、
+//   k+1 個未満になったトランザクションを捨てて、縮んだDBを次のパスに渡す。
+//   除くアイテム:
+//     - どの L_k にも現れないもの
+//     - そのトランザクションに含まれる C_k の候補が k 個未満のもの
+//       (ハッシュ木でのカウント中に tranLen[] まで縮めてある)
+//   サポートは元のトランザクション数 TOTAL_TRANSACTIONS で計算するので、
+//   トランザクションを捨てても結果は変わらない。
+// ==================================================
+// tranLen が NULL でなければ i 番目は先頭 tranLen[i] 個だけを見る
+void trimTransactions(struct tranDB *db, struct itemsetStore *l, const int *tranLen) {
+    int k = l->k;
+    char *keep = (char*)calloc(numDenseItems > 0 ? numDenseItems : 1, 1);
+    if (!keep) {
+        fprintf(stderr, "Error: malloc failed\n");
+        exit(1);
+    }
+    for (long long i = 0; i < l->n * k; i++) {
+        keep[l->items[i]] = 1;
+    }
+    long long nt = 0, w = 0;
+    int maxlen = 0;
+    for (long long t = 0; t < db->n; t++) {
+        long long from = db->offsets[t];
+        long long to = tranLen ? from + tranLen[t] : db->offsets[t+1];
+        long long begin = w;
+        for (long long i = from; i < to; i++) {
+            if (keep[db->items[i]]) db->items[w++] = db->items[i];
+        }
+        if (w - begin < k + 1) {
+            w = begin;   // 短すぎるトランザクションは捨てる
+            continue;
+        }
+        db->offsets[nt++] = begin;
+        if (w - begin > maxlen) maxlen = (int)(w - begin);
+    }
+    db->n = nt;
+    db->offsets[nt] = w;
+    db->nitems = w;
+    db->maxlen = maxlen;
+    free(keep);
+}
+
+// ==================================================
+// パス1の Count-Min スケッチ (--pass1 sketch)
+//   アイテムの種類が非常に多いとき、出現した全アイテムの表を作らずに済ませる。
+//   SKETCH_DEPTH 行 × w 列の 32bit カウンタ (行ごとに別のハッシュ) に頻度を
+//   conservative update で足し込む。推定値 (各行の最小値) は本当の頻度以上なので、
+//   足し込んだ直後の推定値が最小支持度に届いたアイテムだけを候補として itemHash に入れ、
+//   CSR をもう1回走査して候補だけを正確に数える。頻出アイテムは必ず候補になるので、
+//   L1 は通常のパス1と同じになる。メモリはカウンタ (固定) と候補の表だけ。
+// ==================================================
+#define PASS1_EXACT  0
+#define PASS1_SKETCH 1
+#define SKETCH_DEPTH 4
+#define SKETCH_WIDTH_MIN 1024
+#define SKETCH_WIDTH_MAX (1LL<<24)
+static int PASS1_MODE = PASS1_EXACT;
+static long long SKETCH_WIDTH = 0;        // 0 なら平均長と最小支持度から決める (--sketch-width)
+static long long sketch_candidates = 0;   // 正確に数え直した候補の数
+
+// 衝突で上乗せされる量 (平均 = 全出現数/w) が最小支持度の頻度の 1/8 程度になる幅 (2のべき)
+static long long sketchWidth(struct tranDB *db) {
+    long long w = SKETCH_WIDTH;
+    if (w <= 0) {
+        double perItem = db->n > 0 ? (double)db->nitems / (double)db->n : 1.0;
+        double want = 8.0 * perItem / (MIN_SUPPORT_RATIO > 0.0 ? MIN_SUPPORT_RATIO : 1e-6);
+        w = want < (double)SKETCH_WIDTH_MAX ? (long long)want : SKETCH_WIDTH_MAX;
+    }
+    long long p = SKETCH_WIDTH_MIN;
+    while (p < w && p < SKETCH_WIDTH_MAX) p <<= 1;
+    return p;
+}
+// itemHash に候補のアイテムだけを正確な頻度で入れる
+void sketchPass1(struct tranDB *db) {
+    static const uint64_t seeds[SKETCH_DEPTH] = {
+        0x243f6a8885a308d3ULL, 0x13198a2e03707344ULL, 0xa4093822299f31d0ULL, 0x082efa98ec4e6c89ULL
+    };
+    long long w = sketchWidth(db);
+    uint32_t *cms = (uint32_t*)calloc((size_t)(SKETCH_DEPTH * w), sizeof(uint32_t));
+    if (!cms) {
+        fprintf(stderr, "Error: malloc failed\n");
+        exit(1);
+    }
+    SKETCH_WIDTH = w;
+
+    // 1回目: スケッチに足し込み、推定値が最小支持度に届いたら候補にする
+    initItemHash(ITEM_PRESIZE);
+    uint32_t *cell[SKETCH_DEPTH];
+    for (long long i = 0; i < db->nitems; i++) {
+        int item = db->items[i];
+        uint32_t est = UINT32_MAX;
+        for (int r = 0; r < SKETCH_DEPTH; r++) {
+            cell[r] = &cms[r * w + (long long)(mixHash64((uint32_t)item ^ seeds[r]) & (uint64_t)(w - 1))];
+            if (*cell[r] < est) est = *cell[r];
+        }
+        if (est < UINT32_MAX) est++;
+        for (int r = 0; r < SKETCH_DEPTH; r++) {
+            if (*cell[r] < est) *cell[r] = est;
+        }
+        if (isFrequentCount(est, db->n, MIN_SUPPORT_RATIO) && searchItem(item) < 0) {
+            addItemCount(item, 0);
+        }
+    }
+    free(cms);
+    sketch_candidates = itemHash.n;
+
+    // 2回目: 候補だけを正確に数える
+    if (itemHash.n > 0) {
+        for (long long i = 0; i < db->nitems; i++) {
+            long long p = searchItem(db->items[i]);
+            if (p >= 0) itemHash.counts[p]++;
+        }
+    }
+}
+
+// ---------------------------
+// pass1_generateL1
+//   頻出アイテムに密なIDを振り直し、L1 は密なIDの itemsetStore(k=1) として返す
+// ---------------------------
+struct itemsetStore* pass1_generateL1(struct tranDB *db, long long *total_t) {
+    double start = nowSec();
+
+    long long transCount=db->n;
+    if (PASS1_MODE == PASS1_SKETCH) {
+        sketchPass1(db);
+    } else if (NUM_THREADS <= 1) {
+        // アイテムの種類数の見込み (足りなければ表が自分で広がる)
+        initItemHash(db->nitems < ITEM_PRESIZE ? db->nitems : ITEM_PRESIZE);
+        for(long long t=0;t<db->n;t++){
+            for(long long i=db->offsets[t];i<db->offsets[t+1];i++){
+                insertOrUpdateItem(db->items[i]);
+            }
+        }
+    } else {
+        // 各スレッドの (item, count) をスレッド番号順にハッシュ表へ合算
+        initItemHash(db->nitems < ITEM_PRESIZE ? db->nitems : ITEM_PRESIZE);
+        struct pass1Worker *w = (struct pass1Worker*)malloc(sizeof(struct pass1Worker) * NUM_THREADS);
+        long long *bounds = (long long*)malloc(sizeof(long long) * (NUM_THREADS + 1));
+        if (!w || !bounds) {
+            fprintf(stderr, "Error: malloc failed\n");
+            exit(1);
+        }
+        splitByCost(db, 1, NUM_THREADS, bounds);
+        for (int i = 0; i < NUM_THREADS; i++) {
+            w[i].db = db;
+            w[i].begin = bounds[i];
+            w[i].end = bounds[i+1];
+        }
+        runWorkers(pass1Thread, w, sizeof(struct pass1Worker), NUM_THREADS);
+        for (int i = 0; i < NUM_THREADS; i++) {
+            for (long long j = 0; j < w[i].n; j++) {
+                addItemCount(w[i].items[j], w[i].counts[j]);
+            }
+            free(w[i].items);
+            free(w[i].counts);
+        }
+        free(w);
+        free(bounds);
+    }
+
+    // support >= min_sup のアイテムを集める
+    int l1_cap = 1024, l1_count = 0;
+    struct remapEntry *l1_items = (struct remapEntry*)malloc(sizeof(struct remapEntry) * l1_cap);
+    if(!l1_items){
+        fprintf(stderr,"Error: malloc failed for l1_items\n");
+        exit(1);
+    }
+    for(long long h=0;h<itemHash.n;h++){
+        double sup=(double)itemHash.counts[h]/(double)transCount;
+        if(sup >= MIN_SUPPORT_RATIO){
+            if(l1_count>=l1_cap){
+                l1_cap*=2;
+                struct remapEntry *tmp=(struct remapEntry*)realloc(l1_items,sizeof(struct remapEntry)*l1_cap);
+                if(!tmp){
+                    fprintf(stderr,"Error: realloc failed\n");
+                    exit(1);
+                }
+                l1_items=tmp;
+            }
+            l1_items[l1_count].item=itemHash.items[h];
+            l1_items[l1_count].count=itemHash.counts[h];
+            l1_count++;
+        }
+    }
+
+    // パス1の表はここで要らなくなる
+    freeItemHash();
+
+    // 密なIDを振ってDBを書き換え、2個未満のトランザクションを捨てる
+    struct itemsetStore *l1 = remapItems(db, l1_items, l1_count);
+    free(l1_items);
+    trimTransactions(db, l1, NULL);
+
+    // L1.dat (L1.bin) 書き出し
+    writeLevelFile(l1, transCount);
+
+    pass_time[1] += nowSec() - start;
+
+    *total_t = transCount;
+    return l1;
+}
+
+// ==================================================
+// 候補カウント用のハッシュ木 (Agrawal & Srikant の hash-tree)
+//   内部ノードは深さ d で候補の d 番目のアイテムをハッシュして子に振り分け、
+//   葉には C_k の添字を持つ。トランザクションは木をたどりながら
+//   候補になり得る部分集合だけを訪れ、葉では各候補の包含を調べる。
+// ==================================================
+#define HTREE_FANOUT_MIN 16     // 内部ノードの子の数の下限
+#define HTREE_FANOUT_MAX 1024   // 内部ノードの子の数の上限
+#define HTREE_LEAF_MAX   16     // 葉に入れる候補数の上限 (超えたら分割)
+
+// 内部ノードの子の数 (buildHtree で C_k のアイテム種類数から決める)
+//   種類数以上あれば同じ深さでアイテムが衝突せず、葉での包含チェックが減る
+static int htree_fanout = HTREE_FANOUT_MIN;
+
+// 最後に作ったハッシュ木の葉の数
+static long long htree_nleaves = 0;
+
+// ハッシュ木の訪問回数/包含チェック回数 (長さkごと)
+static long long htree_visits[MAX_ITEMSET_LEN+1];
+static long long htree_checks[MAX_ITEMSET_LEN+1];
+
+struct htreeNode {
+    int depth;
+    int isLeaf;
+    long long leafId;             // 葉の通し番号 (スレッドごとの二重カウント防止の印に使う)
+    struct htreeNode **child;     // 内部ノード: htree_fanout 個の子
+    long long *cand;              // 葉: C_k の添字
+    int ncand;
+    int capcand;
+};
+
+int hashHtree(int item) {
+    int h = item % htree_fanout;
+    if (h < 0) h += htree_fanout;
+    return h;
+}
+// ハッシュ木のノード・子の表・葉の候補はすべてこのアリーナから取る
+//   (木はパスごとに作り、数え終わったら freeHtree でまとめて返す)
+static struct memArena *htree_arena = NULL;
+
+struct htreeNode* createHtreeNode(int depth) {
+    struct htreeNode *n = ARENA_NEW(htree_arena, struct htreeNode, 1);
+    n->depth = depth;
+    n->isLeaf = 1;
+    n->leafId = -1;
+    n->child = NULL;
+    n->ncand = 0;
+    n->capcand = HTREE_LEAF_MAX + 1;
+    n->cand = ARENA_NEW(htree_arena, long long, n->capcand);
+    return n;
+}
+void insertHtree(struct htreeNode *node, struct itemsetStore *c, long long idx) {
+    int k = c->k;
+    while (!node->isLeaf) {
+        int h = hashHtree(c->items[idx * k + node->depth]);
+        if (!node->child[h]) node->child[h] = createHtreeNode(node->depth + 1);
+        node = node->child[h];
+    }
+    if (node->ncand >= node->capcand) {
+        // 古い配列はアリーナに残る (倍々なので無駄は高々同じ量)
+        long long *tmp = ARENA_NEW(htree_arena, long long, node->capcand * 2);
+        memcpy(tmp, node->cand, sizeof(long long) * node->capcand);
+        node->capcand *= 2;
+        node->cand = tmp;
+    }
+    node->cand[node->ncand++] = idx;
+
+    // 葉があふれたら内部ノードに変えて振り分け直す (深さkの葉はそのまま)
+    if (node->ncand > HTREE_LEAF_MAX && node->depth < k) {
+        long long *old = node->cand;
+        int nold = node->ncand;
+        node->isLeaf = 0;
+        node->cand = NULL;
+        node->ncand = 0;
+        node->capcand = 0;
+        node->child = ARENA_NEW(htree_arena, struct htreeNode*, htree_fanout);
+        memset(node->child, 0, sizeof(struct htreeNode*) * htree_fanout);
+        for (int i = 0; i < nold; i++) {
+            insertHtree(node, c, old[i]);
+        }
+    }
+}
+static void numberHtreeLeaves(struct htreeNode *node) {
+    if (node->isLeaf) {
+        node->leafId = htree_nleaves++;
+        return;
+    }
+    for (int i = 0; i < htree_fanout; i++) {
+        if (node->child[i]) numberHtreeLeaves(node->child[i]);
+    }
+}
+// nitems は C_k に現れるアイテムの種類数
+struct htreeNode* buildHtree(struct itemsetStore *c, long long nitems) {
+    htree_fanout = HTREE_FANOUT_MIN;
+    while (htree_fanout < nitems && htree_fanout < HTREE_FANOUT_MAX) {
+        htree_fanout *= 2;
+    }
+    if (!htree_arena) htree_arena = createArena(ARENA_BLOCK_SIZE);
+    struct htreeNode *root = createHtreeNode(0);
+    for (long long i = 0; i < c->n; i++) {
+        insertHtree(root, c, i);
+    }
+    htree_nleaves = 0;
+    numberHtreeLeaves(root);
+    return root;
+}
+// 木全体をまとめて返す (ブロックは次のパスの木で使い回す)
+void freeHtree(struct htreeNode *node) {
+    if (!node) return;
+    struct arenaMark empty = {NULL, NULL, 0};
+    arenaRelease(htree_arena, empty);
+}
+
+// 昇順の set[0..k) が昇順の t[0..n) に含まれるか
+//   pos が NULL でなければ、含まれるときに各アイテムの t 上の位置を入れる
+static int isSubsetSorted(const int *set, int k, const int *t, int n, int *pos) {
+    int j = 0;
+    for (int i = 0; i < k; i++) {
+        while (j < n && t[j] < set[i]) j++;
+        if (j >= n || t[j] != set[i]) return 0;
+        if (pos) pos[i] = j;
+        j++;
+    }
+    return 1;
+}
+
+// ハッシュ木でのカウントの作業領域 (スレッドごとに1つ)
+//   木と C_k は読むだけで、頻度は各スレッドのシャード counts[] に数える
+struct htreeCounter {
+    struct itemsetStore *c;
+    uint32_t *counts;      // C_k と同じ並びの頻度 (シャード)
+    long long *leafMark;   // 葉ごとに最後に調べたトランザクション番号
+    int *hits;             // トランザクションの各位置のアイテムを含む候補の数 (刈り込み用)
+    long long visits;
+    long long checks;
+};
+
+// トランザクション t[0..n) (昇順) に含まれる候補の頻度を1増やす
+//   start 以降のアイテムだけを次の深さのハッシュに使う
+void countHtree(struct htreeNode *node, struct htreeCounter *hc, const int *t, int n, int start, long long tid) {
+    struct itemsetStore *c = hc->c;
+    int k = c->k;
+    hc->visits++;
+    if (node->isLeaf) {
+        if (hc->leafMark[node->leafId] == tid) return;
+        hc->leafMark[node->leafId] = tid;
+        for (int i = 0; i < node->ncand; i++) {
+            long long idx = node->cand[i];
+            hc->checks++;
+            int pos[MAX_ITEMSET_LEN];
+            if (isSubsetSorted(&c->items[idx * k], k, t, n, pos)) {
+                hc->counts[idx]++;
+                for (int j = 0; j < k; j++) hc->hits[pos[j]]++;
+            }
+        }
+        return;
+    }
+    for (int i = start; i <= n - (k - node->depth); i++) {
+        struct htreeNode *ch = node->child[hashHtree(t[i])];
+        if (ch) countHtree(ch, hc, t, n, i + 1, tid);
+    }
+}
+
+// ---------------------------
+// C_k 生成 (prefix結合 + (k-1)部分集合による枝刈り)
+//   L_{k-1} は辞書順に並んでいるので、先頭 k-2 個が等しいセットは連続する。
+//   その範囲の中だけで2つずつ結合し、残りの (k-1)部分集合がすべて
+//   L_{k-1} にあるものだけを候補にする。生成される C_k も辞書順になる。
+// ---------------------------
+struct itemsetStore* generateCandidates(struct itemsetStore *prev) {
+    int k = prev->k + 1;
+
+    // 候補数の上限: 先頭 k-2 個が等しい範囲ごとに g(g-1)/2 (k=2 なら |L1| choose 2)
+    long long expected = 0;
+    long long i = 0;
+    while (i < prev->n) {
+        long long g = i + 1;
+        while (g < prev->n &&
+               memcmp(&prev->items[i * prev->k], &prev->items[g * prev->k], sizeof(int) * (k-2)) == 0) {
+            g++;
+        }
+        expected += (g - i) * (g - i - 1) / 2;
+        i = g;
+    }
+    if (expected > CANDIDATE_PRESIZE_MAX) expected = CANDIDATE_PRESIZE_MAX;
+    struct itemsetStore *c = createItemsetStore(k, expected);
+    int cand[MAX_ITEMSET_LEN];
+    int sub[MAX_ITEMSET_LEN];
+
+    i = 0;
+    while (i < prev->n) {
+        // 先頭 k-2 個が等しい範囲 [i, g) を求める
+        long long g = i + 1;
+        while (g < prev->n &&
+               memcmp(&prev->items[i * prev->k], &prev->items[g * prev->k], sizeof(int) * (k-2)) == 0) {
+            g++;
+        }
+        for (long long a = i; a < g; a++) {
+            for (long long b = a + 1; b < g; b++) {
+                memcpy(cand, &prev->items[a * prev->k], sizeof(int) * (k-1));
+                cand[k-1] = prev->items[b * prev->k + (k-2)];
+
+                // 末尾2個のどちらかを除いた部分集合は結合元そのものなので、
+                // 先頭 k-2 個のうち1つを除いた部分集合だけ調べる
+                int ok = 1;
+                for (int drop = 0; drop < k-2 && ok; drop++) {
+                    int m = 0;
+                    for (int x = 0; x < k; x++) {
+                        if (x != drop) sub[m++] = cand[x];
+                    }
+                    if (searchItemset(prev, sub) < 0) ok = 0;
+                }
+                if (ok) {
+                    insertItemset(c, cand, 0);
+                }
+            }
+        }
+        i = g;
+    }
+    return c;
+}
+
+// パスkのスレッド: 区間内のトランザクションをハッシュ木で数える
+struct passKWorker {
+    struct tranDB *db;
+    struct itemsetStore *l1;
+    const char *used;          // C_k に現れるアイテムの印 (密なIDで引く)
+    struct htreeNode *root;
+    long long begin, end;
+    int *tranLen;              // 刈り込み後の各トランザクションの長さ (出力)
+    struct htreeCounter hc;
+};
+static void* passKThread(void *arg) {
+    struct passKWorker *w = (struct passKWorker*)arg;
+    struct tranDB *db = w->db;
+    int k = w->hc.c->k;
+    int *items = (int*)malloc(sizeof(int) * (db->maxlen > 0 ? db->maxlen : 1));
+    w->hc.hits = (int*)malloc(sizeof(int) * (db->maxlen > 0 ? db->maxlen : 1));
+    if(!items || !w->hc.hits){
+        fprintf(stderr,"Error: malloc failed\n");
+        exit(1);
+    }
+    for(long long t=w->begin;t<w->end;t++){
+        int ac=0;
+        for(long long i=db->offsets[t];i<db->offsets[t+1];i++){
+            int it=db->items[i];
+            // C_k に現れないアイテムは部分集合の列挙から外す (昇順は保たれる)
+            if(!w->used[it]) continue;
+            items[ac++]=it;
+        }
+        int m=0;
+        if(ac>=k){
+            memset(w->hc.hits, 0, sizeof(int) * ac);
+            countHtree(w->root, &w->hc, items, ac, 0, t);
+            // 含まれる候補が k 個未満のアイテムは (k+1)-アイテムセットに入れない
+            // ので、残すものだけを自分のトランザクションの領域に書き戻す
+            for(int i=0;i<ac;i++){
+                if(w->hc.hits[i]>=k) db->items[db->offsets[t]+m++]=items[i];
+            }
+        }
+        w->tranLen[t]=m;
+    }
+    free(items);
+    free(w->hc.hits);
+    return NULL;
+}
+
+// パス2のスレッド: 密なID 0..n-1 のペアを上三角行列で数える
+struct pass2Worker {
+    struct tranDB *db;
+    long long begin, end;
+    uint32_t *matrix;      // n(n-1)/2 個のカウンタ (シャード)
+    const long long *rowBase;
+};
+static void* pass2Thread(void *arg) {
+    struct pass2Worker *w = (struct pass2Worker*)arg;
+    struct tranDB *db = w->db;
+    for(long long t=w->begin;t<w->end;t++){
+        // DBは密なID (=L1 の添字) の昇順になっている
+        const int *ranks = &db->items[db->offsets[t]];
+        int ac = (int)(db->offsets[t+1] - db->offsets[t]);
+        for(int i=0;i<ac;i++){
+            long long base = w->rowBase[ranks[i]];
+            for(int j=i+1;j<ac;j++){
+                w->matrix[base + ranks[j]]++;
+            }
+        }
+    }
+    return NULL;
+}
+// スレッド数ぶんの三角行列が予算に収まるか
+int pairMatrixFits(long long n) {
+    long long cells = n * (n - 1) / 2;
+    return cells * (long long)sizeof(uint32_t) * NUM_THREADS <= PAIR_MATRIX_BUDGET;
+}
+// ---------------------------
+// pass2_countMatrix
+//   密なID 0..n-1 の (i<j) の頻度を上三角行列 matrix[rowBase[i] + j] に
+//   数える。C2 は作らず、行列を走査して L2 を辞書順のまま直接取り出す。
+// ---------------------------
+struct itemsetStore* pass2_countMatrix(struct tranDB *db, struct itemsetStore *l1, long long total_t) {
+    long long n = l1->n;
+    long long cells = n * (n - 1) / 2;
+    long long *rowBase = (long long*)malloc(sizeof(long long) * (n > 0 ? n : 1));
+    struct pass2Worker *w = (struct pass2Worker*)malloc(sizeof(struct pass2Worker) * NUM_THREADS);
+    long long *bounds = (long long*)malloc(sizeof(long long) * (NUM_THREADS + 1));
+    if (!rowBase || !w || !bounds) {
+        fprintf(stderr, "Error: malloc failed\n");
+        exit(1);
+    }
+    // 行 i の先頭は i*(2n-i-1)/2 で、列 j (>i) は rowBase[i] + j
+    // (rowBase[0] は -1 になるので、ポインタに足さず添字として使う)
+    for (long long i = 0; i < n; i++) {
+        rowBase[i] = i * (2 * n - i - 1) / 2 - i - 1;
+    }
+    splitByCost(db, 2, NUM_THREADS, bounds);
+    for (int i = 0; i < NUM_THREADS; i++) {
+        w[i].db = db;
+        w[i].begin = bounds[i];
+        w[i].end = bounds[i+1];
+        w[i].rowBase = rowBase;
+        w[i].matrix = (uint32_t*)calloc(cells > 0 ? cells : 1, sizeof(uint32_t));
+        if (!w[i].matrix) {
+            fprintf(stderr, "Error: malloc failed for pair matrix\n");
+            exit(1);
+        }
+    }
+    runWorkers(pass2Thread, w, sizeof(struct pass2Worker), NUM_THREADS);
+    // シャードをスレッド番号順に先頭の行列へ合算
+    for (int i = 1; i < NUM_THREADS; i++) {
+        for (long long x = 0; x < cells; x++) {
+            w[0].matrix[x] += w[i].matrix[x];
+        }
+        free(w[i].matrix);
+    }
+
+    struct itemsetStore *l = createItemsetStore(2, 0);
+    for (long long i = 0; i < n; i++) {
+        for (long long j = i + 1; j < n; j++) {
+            uint32_t count = w[0].matrix[rowBase[i] + j];
+            if (isFrequentCount(count, total_t, MIN_SUPPORT_RATIO)) {
+                int set[2] = { l1->items[i], l1->items[j] };
+                insertItemset(l, set, count);
+            }
+        }
+    }
+    free(w[0].matrix);
+    free(w);
+    free(bounds);
+    free(rowBase);
+    return l;
+}
+
+// ハッシュ木で C_k の頻度を数える (スレッドごとにシャードへ数え、番号順に合算)
+//   あわせて各トランザクションを次のパスに不要なアイテムを除いた長さに縮め、
+//   その長さを tranLen[] に返す (CSR の詰め直しは trimTransactions で行う)
+void countCandidates(struct tranDB *db, struct itemsetStore *l1, struct itemsetStore *c, int *tranLen) {
+    int k = c->k;
+    if (c->n == 0) {
+        memset(tranLen, 0, sizeof(int) * db->n);
+        return;
+    }
+
+    // C_k に現れるアイテムに印をつける (密なIDで管理)
+    char *used = (char*)calloc(l1->n > 0 ? l1->n : 1, 1);
+    if(!used){
+        fprintf(stderr,"Error: malloc failed\n");
+        exit(1);
+    }
+    long long nused = 0;
+    for (long long i = 0; i < c->n * k; i++) {
+        if (!used[c->items[i]]) {
+            used[c->items[i]] = 1;
+            nused++;
+        }
+    }
+
+    struct htreeNode *root = buildHtree(c, nused);
+    struct passKWorker *w = (struct passKWorker*)malloc(sizeof(struct passKWorker) * NUM_THREADS);
+    long long *bounds = (long long*)malloc(sizeof(long long) * (NUM_THREADS + 1));
+    if (!w || !bounds) {
+        fprintf(stderr, "Error: malloc failed\n");
+        exit(1);
+    }
+    splitByCost(db, k, NUM_THREADS, bounds);
+    for (int i = 0; i < NUM_THREADS; i++) {
+        w[i].db = db;
+        w[i].l1 = l1;
+        w[i].used = used;
+        w[i].root = root;
+        w[i].begin = bounds[i];
+        w[i].end = bounds[i+1];
+        w[i].tranLen = tranLen;
+        w[i].hc.c = c;
+        w[i].hc.counts = (uint32_t*)calloc(c->n, sizeof(uint32_t));
+        w[i].hc.leafMark = (long long*)malloc(sizeof(long long) * htree_nleaves);
+        w[i].hc.visits = 0;
+        w[i].hc.checks = 0;
+        if (!w[i].hc.counts || !w[i].hc.leafMark) {
+            fprintf(stderr, "Error: malloc failed\n");
+            exit(1);
+        }
+        for (long long j = 0; j < htree_nleaves; j++) w[i].hc.leafMark[j] = -1;
+    }
+    runWorkers(passKThread, w, sizeof(struct passKWorker), NUM_THREADS);
+    for (int i = 0; i < NUM_THREADS; i++) {
+        for (long long j = 0; j < c->n; j++) {
+            c->counts[j] += w[i].hc.counts[j];
+        }
+        htree_visits[k] += w[i].hc.visits;
+        htree_checks[k] += w[i].hc.checks;
+        free(w[i].hc.counts);
+        free(w[i].hc.leafMark);
+    }
+    free(w);
+    free(bounds);
+    freeHtree(root);
+    free(used);
+}
+
+// ==================================================
+// ビットマップによる頻度カウント (--counting)
+//   C_k に現れるアイテムごとに、トランザクション1件を1ビットとする
+//   ビットマップを作り、候補の頻度を各アイテムのビットマップの AND の
+//   popcount で求める (AVX2 の pshufb 表引き、または AVX-512 VPOPCNTDQ)。
+//   C_k は辞書順なので、先頭 k-1 個が等しい候補の間では prefix の AND を
+//   使い回し、候補ごとには最後のアイテムとの AND + popcount だけを行う。
+//   DB はパスごとに刈り込まれて番号が詰め直されるので、ビットマップは
+//   各パスの始めに今のDBから作り直す (1回の走査で済む)。
+// ==================================================
+#define COUNT_AUTO   0   // パス2は三角行列、それ以外は推定コストの小さい方
+#define COUNT_HTREE  1   // ハッシュ木 (パス2は三角行列が収まればそれ)
+#define COUNT_BITMAP 2   // 予算に収まればビットマップ
+#define BITMAP_BUDGET (256LL*1024*1024)  // ビットマップに使ってよいバイト数
+#define BITMAP_WORD_COST 0.125           // 1語の AND+popcount ≒ 部分集合1個の探索の何倍か
+
+static int COUNTING_MODE = COUNT_AUTO;
+static long long bitmap_words[MAX_ITEMSET_LEN+1];   // AND した 64bit 語の数 (長さkごと)
+
+static uint64_t andPopcountScalar(const uint64_t *a, const uint64_t *b, long long w) {
+    uint64_t c = 0;
+    for (long long i = 0; i < w; i++) c += (uint64_t)__builtin_popcountll(a[i] & b[i]);
+    return c;
+}
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define HAVE_SIMD_POPCNT 1
+// 4ビットごとの表引きで各バイトのビット数を求め、sad で 64bit ごとに足す
+__attribute__((target("avx2,popcnt")))
+static uint64_t andPopcountAvx2(const uint64_t *a, const uint64_t *b, long long w) {
+    const __m256i lookup = _mm256_setr_epi8(0,1,1,2,1,2,2,3,1,2,2,3,2,3,3,4,
+                                            0,1,1,2,1,2,2,3,1,2,2,3,2,3,3,4);
+    const __m256i low = _mm256_set1_epi8(0x0f);
+    __m256i acc = _mm256_setzero_si256();
+    long long i = 0;
+    for (; i + 4 <= w; i += 4) {
+        __m256i v = _mm256_and_si256(_mm256_loadu_si256((const __m256i*)&a[i]),
+                                     _mm256_loadu_si256((const __m256i*)&b[i]));
+        __m256i lo = _mm256_and_si256(v, low);
+        __m256i hi = _mm256_and_si256(_mm256_srli_epi16(v, 4), low);
+        __m256i cnt = _mm256_add_epi8(_mm256_shuffle_epi8(lookup, lo), _mm256_shuffle_epi8(lookup, hi));
+        acc = _mm256_add_epi64(acc, _mm256_sad_epu8(cnt, _mm256_setzero_si256()));
+    }
+    uint64_t c = (uint64_t)_mm256_extract_epi64(acc, 0) + (uint64_t)_mm256_extract_epi64(acc, 1)
+               + (uint64_t)_mm256_extract_epi64(acc, 2) + (uint64_t)_mm256_extract_epi64(acc, 3);
+    for (; i < w; i++) c += (uint64_t)__builtin_popcountll(a[i] & b[i]);
+    return c;
+}
+__attribute__((target("avx512f,avx512vpopcntdq,popcnt")))
+static uint64_t andPopcountAvx512(const uint64_t *a, const uint64_t *b, long long w) {
+    __m512i acc = _mm512_setzero_si512();
+    long long i = 0;
+    for (; i + 8 <= w; i += 8) {
+        __m512i v = _mm512_and_si512(_mm512_loadu_si512((const void*)&a[i]),
+                                     _mm512_loadu_si512((const void*)&b[i]));
+        acc = _mm512_add_epi64(acc, _mm512_popcnt_epi64(v));
+    }
+    uint64_t c = (uint64_t)_mm512_reduce_add_epi64(acc);
+    for (; i < w; i++) c += (uint64_t)__builtin_popcountll(a[i] & b[i]);
+    return c;
+}
+#endif
+
+static uint64_t (*andPopcount)(const uint64_t*, const uint64_t*, long long) = andPopcountScalar;
+static void initPopcount() {
+#ifdef HAVE_SIMD_POPCNT
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512vpopcntdq")) andPopcount = andPopcountAvx512;
+    else if (__builtin_cpu_supports("avx2")) andPopcount = andPopcountAvx2;
+#endif
+}
+
+// パスkのスレッド: 候補の区間 [begin, end) の頻度をビットマップで求める
+struct bitmapWorker {
+    struct itemsetStore *c;
+    const uint64_t *bits;   // アイテム row[x] のビットマップは bits[row[x]*W] から
+    const int *row;
+    long long W;            // ビットマップ1本の語数
+    long long begin, end;
+    long long words;        // AND した語数 (出力)
+};
+static void* bitmapThread(void *arg) {
+    struct bitmapWorker *w = (struct bitmapWorker*)arg;
+    struct itemsetStore *c = w->c;
+    int k = c->k;
+    long long W = w->W;
+    uint64_t *pre = (uint64_t*)malloc(sizeof(uint64_t) * (W > 0 ? W : 1));
+    if (!pre) {
+        fprintf(stderr, "Error: malloc failed\n");
+        exit(1);
+    }
+    const int *preSet = NULL;   // pre に入っている prefix (k>=3)
+    w->words = 0;
+    for (long long i = w->begin; i < w->end; i++) {
+        const int *set = &c->items[i * k];
+        const uint64_t *first = pre;
+        if (k == 2) {
+            first = w->bits + w->row[set[0]] * W;
+        } else if (!preSet || memcmp(preSet, set, sizeof(int) * (k-1)) != 0) {
+            // prefix が変わったら先頭 k-1 個の AND を作り直す
+            const uint64_t *b0 = w->bits + w->row[set[0]] * W;
+            const uint64_t *b1 = w->bits + w->row[set[1]] * W;
+            for (long long j = 0; j < W; j++) pre[j] = b0[j] & b1[j];
+            for (int x = 2; x < k-1; x++) {
+                const uint64_t *bx = w->bits + w->row[set[x]] * W;
+                for (long long j = 0; j < W; j++) pre[j] &= bx[j];
+            }
+            w->words += (long long)(k-2) * W;
+            preSet = set;
+        }
+        c->counts[i] += (long long)andPopcount(first, w->bits + w->row[set[k-1]] * W, W);
+        w->words += W;
+    }
+    free(pre);
+    return NULL;
+}
+
+// C_k をビットマップで数えるか (予算に収まり、推定コストがハッシュ木より小さいとき)
+int useBitmapCounting(struct tranDB *db, struct itemsetStore *c) {
+    if (COUNTING_MODE == COUNT_HTREE || c->n == 0) return 0;
+    int k = c->k;
+    char *used = (char*)calloc(numDenseItems > 0 ? numDenseItems : 1, 1);
+    if (!used) {
+        fprintf(stderr, "Error: malloc failed\n");
+        exit(1);
+    }
+    long long rows = 0;
+    for (long long i = 0; i < c->n * k; i++) {
+        if (!used[c->items[i]]) {
+            used[c->items[i]] = 1;
+            rows++;
+        }
+    }
+    free(used);
+    long long W = (db->n + 63) / 64;
+    if (rows * W * (long long)sizeof(uint64_t) > BITMAP_BUDGET) return 0;
+    if (COUNTING_MODE == COUNT_BITMAP) return 1;
+
+    // ビットマップ: prefix ごとに (k-2) 語 x W、候補ごとに W 語
+    // ハッシュ木: トランザクションごとに min(C(|t|,k), |C_k|) 個の部分集合
+    long long groups = 0;
+    for (long long i = 0; i < c->n; i++) {
+        if (i == 0 || memcmp(&c->items[(i-1) * k], &c->items[i * k], sizeof(int) * (k-1)) != 0) groups++;
+    }
+    double bitmapCost = ((double)groups * (k - 2) + (double)c->n) * (double)W * BITMAP_WORD_COST;
+    double htreeCost = 0.0;
+    for (long long t = 0; t < db->n; t++) {
+        double s = combCost((int)(db->offsets[t+1] - db->offsets[t]), k);
+        htreeCost += s < (double)c->n ? s : (double)c->n;
+    }
+    return bitmapCost < htreeCost;
+}
+
+// C_k の頻度を c->counts[] にビットマップで数えて足す
+// (ハッシュ木と同じく、複数のDBを続けて数えると合計になる)
+void countCandidatesBitmap(struct tranDB *db, struct itemsetStore *c) {
+    static int initialized = 0;
+    if (!initialized) {
+        initPopcount();
+        initialized = 1;
+    }
+    int k = c->k;
+    long long W = (db->n + 63) / 64;
+
+    // C_k に現れるアイテムだけに行を割り当てる
+    int *row = (int*)malloc(sizeof(int) * (numDenseItems > 0 ? numDenseItems : 1));
+    if (!row) {
+        fprintf(stderr, "Error: malloc failed\n");
+        exit(1);
+    }
+    for (int x = 0; x < numDenseItems; x++) row[x] = -1;
+    long long rows = 0;
+    for (long long i = 0; i < c->n * k; i++) {
+        if (row[c->items[i]] < 0) row[c->items[i]] = (int)rows++;
+    }
+    uint64_t *bits = (uint64_t*)calloc((size_t)(rows * W > 0 ? rows * W : 1), sizeof(uint64_t));
+    if (!bits) {
+        fprintf(stderr, "Error: malloc failed\n");
+        exit(1);
+    }
+    for (long long t = 0; t < db->n; t++) {
+        for (long long p = db->offsets[t]; p < db->offsets[t+1]; p++) {
+            int r = row[db->items[p]];
+            if (r >= 0) bits[r * W + (t >> 6)] |= 1ULL << (t & 63);
+        }
+    }
+
+    // 候補を連続した区間に分けて並列に数える (区間の先頭で prefix を作り直す)
+    struct bitmapWorker *w = (struct bitmapWorker*)malloc(sizeof(struct bitmapWorker) * NUM_THREADS);
+    if (!w) {
+        fprintf(stderr, "Error: malloc failed\n");
+        exit(1);
+    }
+    for (int i = 0; i < NUM_THREADS; i++) {
+        w[i].c = c;
+        w[i].bits = bits;
+        w[i].row = row;
+        w[i].W = W;
+        w[i].begin = c->n * i / NUM_THREADS;
+        w[i].end = c->n * (i + 1) / NUM_THREADS;
+    }
+    runWorkers(bitmapThread, w, sizeof(struct bitmapWorker), NUM_THREADS);
+    for (int i = 0; i < NUM_THREADS; i++) {
+        bitmap_words[k] += w[i].words;
+    }
+    free(w);
+    free(bits);
+    free(row);
+}
+
+// C_k の頻度を c->counts[] に数えて足す (ビットマップかハッシュ木)。ハッシュ木のときは
+// 縮めた各トランザクションの長さを返す (trimTransactions に渡す。ビットマップなら NULL)
+int* countCandidatesAuto(struct tranDB *db, struct itemsetStore *l1, struct itemsetStore *c) {
+    if (useBitmapCounting(db, c)) {
+        countCandidatesBitmap(db, c);
+        return NULL;
+    }
+    int *tranLen = (int*)malloc(sizeof(int) * (db->n > 0 ? db->n : 1));
+    if (!tranLen) {
+        fprintf(stderr, "Error: malloc failed\n");
+        exit(1);
+    }
+    countCandidates(db, l1, c, tranLen);
+    return tranLen;
+}
+
+// ---------------------------
+// passK_generateLk
+//   L_{k-1} から C_k を作り、トランザクションDBを走査して L_k を求める
+//   k=2 で L1 が小さければ三角行列、それ以外はビットマップかハッシュ木で数える
+// ---------------------------
+struct itemsetStore* passK_generateLk(struct tranDB *db, struct itemsetStore *l1,
+                                      struct itemsetStore *prev, long long total_t) {
+    double start = nowSec();
+    int k = prev->k + 1;
+    struct itemsetStore *l;
+
+    if (k == 2 && COUNTING_MODE != COUNT_BITMAP && pairMatrixFits(l1->n)) {
+        l = pass2_countMatrix(db, l1, total_t);
+        trimTransactions(db, l, NULL);
+    } else {
+        // A) C_k 生成
+        struct itemsetStore *c = generateCandidates(prev);
+        // B) 頻度カウント
+        int *tranLen = countCandidatesAuto(db, l1, c);
+        // C) L_k を取り出し、次のパスのためにDBを縮める
+        l = extractFrequent(c, total_t);
+        freeItemsetStore(c);
+        trimTransactions(db, l, tranLen);
+        free(tranLen);
+    }
+
+    // Lk.dat (Lk.bin) 出力
+    writeLevelFile(l, total_t);
+
+    pass_time[k] += nowSec() - start;
+
+    return l;
+}
+
+// ==================================================
+// 深さ優先のマイニング (FP-Growth / Eclat) の結果
+//   見つかった頻出アイテムセットを長さごとの itemsetStore に集め、
+//   最後に辞書順に並べて Apriori と同じ Lk.dat を書き、ルール抽出にも渡す
+// ==================================================
+struct mineResult {
+    struct itemsetStore *levels[MAX_ITEMSET_LEN+1];
+    int maxk;
+};
+static void recordItemset(struct mineResult *res, const int *set, int k, long long count) {
+    if (k < 2) return;   // L1 はパス1で出力済み
+    if (k > MAX_ITEMSET_LEN) {
+        fprintf(stderr, "Error: itemset longer than MAX_ITEMSET_LEN=%d\n", MAX_ITEMSET_LEN);
+        exit(1);
+    }
+    int sorted[MAX_ITEMSET_LEN];
+    memcpy(sorted, set, sizeof(int) * k);
+    sortItems(sorted, k);
+    if (!res->levels[k]) res->levels[k] = createItemsetStore(k, 0);
+    insertItemset(res->levels[k], sorted, count);
+    if (k > res->maxk) res->maxk = k;
+}
+
+
+// L2..Lk.dat を書き出す (表は res に残してルール抽出に渡す)。
+// 戻り値は出力した最大の k (ルール抽出のため最低でも3)
+int writeMineResult(struct mineResult *res, const char *label, long long total_t) {
+    // Lk.dat 出力 (Apriori と同じく辞書順に並べる)
+    int maxk = res->maxk < 3 ? 3 : res->maxk;
+    for (int k = 2; k <= maxk; k++) {
+        if (!res->levels[k]) res->levels[k] = createItemsetStore(k, 0);
+        sortItemsetStore(res->levels[k]);
+        writeLevelFile(res->levels[k], total_t);
+
+        char filename[64];
+        levelFileName(k, filename, sizeof(filename));
+        printf("=== %s -> %s ===\n", label, filename);
+        if (k == 2)      printf("Found %lld frequent pairs\n", res->levels[k]->n);
+        else if (k == 3) printf("Found %lld frequent triples\n", res->levels[k]->n);
+        else             printf("Found %lld frequent %d-itemsets\n", res->levels[k]->n, k);
+    }
+    return maxk;
+}
+
+// ==================================================
+// FP-Growth (--engine fpgrowth)
+//   1回目の走査 (パス1) で頻出アイテムと密なIDを決め、2回目の走査で
+//   各トランザクションを密なIDの昇順 (=頻度の降順) に FP-tree へ挿入する。
+//   木 (ノードと表) はアリーナから確保する。条件付き FP-tree は作った順と
+//   逆順に捨てられるので、作る前の位置まで戻すだけで一括で解放できる。
+//   頻度の低いアイテムから順に条件付きパターン基底を作り、
+//   条件付き FP-tree を再帰的に掘って頻出アイテムセットを列挙する。
+//   結果は長さごとの itemsetStore に集め、Apriori と同じ Lk.dat を書く。
+// ==================================================
+struct fpNode {
+    int item;
+    long long count;
+    struct fpNode *parent;
+    struct fpNode *child;     // 先頭の子
+    struct fpNode *sibling;   // 次の兄弟
+    struct fpNode *link;      // 同じアイテムの次のノード (ノードリンク)
+};
+struct fpTree {
+    int nitems;               // アイテムIDの範囲 [0, nitems)
+    struct fpNode root;
+    struct fpNode **head;     // アイテムごとのノードリンクの先頭
+    struct fpNode **rootChild;// 根の子はアイテムIDで直接引く (根は子が多い)
+    long long *count;         // アイテムごとの頻度 (木全体)
+    struct arenaMark mark;    // この木を作る前のアリーナの位置
+};
+
+static double fp_build_time = 0.0;
+static double fp_mine_time = 0.0;
+static long long fp_nodes = 0;    // 確保した FP-tree ノードの総数
+
+static struct memArena *fp_arena = NULL;   // すべての FP-tree が使うアリーナ
+
+struct fpNode* allocFpNode() {
+    fp_nodes++;
+    return ARENA_NEW(fp_arena, struct fpNode, 1);
+}
+struct fpTree* createFpTree(int nitems) {
+    if (!fp_arena) fp_arena = createArena(ARENA_BLOCK_SIZE);
+    struct arenaMark mark = arenaGetMark(fp_arena);
+    struct fpTree *tree = ARENA_NEW(fp_arena, struct fpTree, 1);
+    tree->mark = mark;
+    tree->nitems = nitems;
+    tree->root.item = -1;
+    tree->root.count = 0;
+    tree->root.parent = NULL;
+    tree->root.child = NULL;
+    tree->root.sibling = NULL;
+    tree->root.link = NULL;
+    tree->head = ARENA_NEW(fp_arena, struct fpNode*, nitems > 0 ? nitems : 1);
+    tree->rootChild = ARENA_NEW(fp_arena, struct fpNode*, nitems > 0 ? nitems : 1);
+    tree->count = ARENA_NEW(fp_arena, long long, nitems > 0 ? nitems : 1);
+    memset(tree->head, 0, sizeof(struct fpNode*) * (nitems > 0 ? nitems : 1));
+    memset(tree->rootChild, 0, sizeof(struct fpNode*) * (nitems > 0 ? nitems : 1));
+    memset(tree->count, 0, sizeof(long long) * (nitems > 0 ? nitems : 1));
+    return tree;
+}
+// tree とその後に作った木をまとめて捨てる (作った順と逆順に呼ぶこと)
+void freeFpTree(struct fpTree *tree) {
+    arenaRelease(fp_arena, tree->mark);
+}
+// 昇順のアイテム列 path[0..len) を頻度 cnt で挿入する
+void insertFpPath(struct fpTree *tree, const int *path, int len, long long cnt) {
+    struct fpNode *cur = &tree->root;
+    for (int i = 0; i < len; i++) {
+        struct fpNode *ch;
+        if (i == 0) {
+            ch = tree->rootChild[path[i]];
+        } else {
+            ch = cur->child;
+            while (ch && ch->item != path[i]) ch = ch->sibling;
+        }
+        if (!ch) {
+            ch = allocFpNode();
+            ch->item = path[i];
+            ch->count = 0;
+            ch->parent = cur;
+            ch->child = NULL;
+            ch->sibling = cur->child;
+            cur->child = ch;
+            ch->link = tree->head[path[i]];
+            tree->head[path[i]] = ch;
+            if (i == 0) tree->rootChild[path[i]] = ch;
+        }
+        ch->count += cnt;
+        tree->count[path[i]] += cnt;
+        cur = ch;
+    }
+}
+
+// 一本道の木: 道の上のノードの任意の組合せと prefix の和が頻出
+static void fpMineSinglePath(struct fpNode **path, int m, int from, int *prefix, int plen,
+                             long long minCnt, struct mineResult *res) {
+    for (int i = from; i < m; i++) {
+        prefix[plen] = path[i]->item;
+        // 深い方のノードの頻度がその組合せの頻度
+        long long c = path[i]->count < minCnt ? path[i]->count : minCnt;
+        recordItemset(res, prefix, plen + 1, c);
+        fpMineSinglePath(path, m, i + 1, prefix, plen + 1, c, res);
+    }
+}
+
+// tree の中で prefix[0..plen) を含む頻出アイテムセットを列挙する
+void fpMine(struct fpTree *tree, int *prefix, int plen, long long total_t, struct mineResult *res) {
+    if (plen >= MAX_ITEMSET_LEN) return;
+
+    // 一本道なら組合せを直接列挙する
+    int single = 1, m = 0;
+    for (struct fpNode *p = tree->root.child; p; p = p->child) {
+        if (p->sibling) { single = 0; break; }
+        m++;
+    }
+    if (single) {
+        struct fpNode **path = (struct fpNode**)malloc(sizeof(struct fpNode*) * (m > 0 ? m : 1));
+        if (!path) {
+            fprintf(stderr, "Error: malloc failed\n");
+            exit(1);
+        }
+        int i = 0;
+        for (struct fpNode *p = tree->root.child; p; p = p->child) path[i++] = p;
+        fpMineSinglePath(path, m, 0, prefix, plen, LLONG_MAX, res);
+        free(path);
+        return;
+    }
+
+    long long *cnt = (long long*)malloc(sizeof(long long) * (tree->nitems > 0 ? tree->nitems : 1));
+    int *buf = (int*)malloc(sizeof(int) * (tree->nitems > 0 ? tree->nitems : 1));
+    if (!cnt || !buf) {
+        fprintf(stderr, "Error: malloc failed\n");
+        exit(1);
+    }
+    // 頻度の低い (IDの大きい) アイテムから
+    for (int x = tree->nitems - 1; x >= 0; x--) {
+        if (!tree->head[x] || !isFrequentCount(tree->count[x], total_t, MIN_SUPPORT_RATIO)) continue;
+        prefix[plen] = x;
+        recordItemset(res, prefix, plen + 1, tree->count[x]);
+
+        // 条件付きパターン基底: x の各ノードから根までの道 (x より小さいID)
+        memset(cnt, 0, sizeof(long long) * x);
+        int any = 0;
+        for (struct fpNode *n = tree->head[x]; n; n = n->link) {
+            for (struct fpNode *p = n->parent; p != &tree->root; p = p->parent) {
+                cnt[p->item] += n->count;
+            }
+        }
+        for (int i = 0; i < x; i++) {
+            if (cnt[i] > 0 && isFrequentCount(cnt[i], total_t, MIN_SUPPORT_RATIO)) { any = 1; break; }
+        }
+        if (!any) continue;
+
+        // 頻出なアイテムだけで条件付き FP-tree を作る
+        struct fpTree *cond = createFpTree(x);
+        for (struct fpNode *n = tree->head[x]; n; n = n->link) {
+            int len = 0;
+            for (struct fpNode *p = n->parent; p != &tree->root; p = p->parent) {
+                if (isFrequentCount(cnt[p->item], total_t, MIN_SUPPORT_RATIO)) buf[len++] = p->item;
+            }
+            if (len == 0) continue;
+            // 根に向かって集めたので逆順 (昇順) に直す
+            for (int i = 0; i < len / 2; i++) {
+                int tmp = buf[i]; buf[i] = buf[len-1-i]; buf[len-1-i] = tmp;
+            }
+            insertFpPath(cond, buf, len, n->count);
+        }
+        fpMine(cond, prefix, plen + 1, total_t, res);
+        freeFpTree(cond);
+    }
+    free(cnt);
+    free(buf);
+}
+
+// ---------------------------
+// fpgrowth_generateLk
+//   L1 (パス1の結果、密なID) と DB から FP-tree を作り、L2..Lk を res に集めて書き出す。
+//   戻り値は出力した最大の k (ルール抽出のため最低でも3)
+// ---------------------------
+int fpgrowth_generateLk(struct tranDB *db, struct itemsetStore *l1, long long total_t, struct mineResult *res) {
+    // 2回目の走査: FP-tree 構築
+    double start = nowSec();
+    struct fpTree *tree = createFpTree((int)l1->n);
+    for (long long t = 0; t < db->n; t++) {
+        insertFpPath(tree, &db->items[db->offsets[t]],
+                     (int)(db->offsets[t+1] - db->offsets[t]), 1);
+    }
+    fp_build_time += nowSec() - start;
+
+    // マイニング
+    start = nowSec();
+    int prefix[MAX_ITEMSET_LEN];
+    fpMine(tree, prefix, 0, total_t, res);
+    freeFpTree(tree);
+    freeArena(fp_arena);
+    fp_arena = NULL;
+    fp_mine_time += nowSec() - start;
+
+    int maxk = writeMineResult(res, "FP-Growth", total_t);
+    printf("FP-tree build time: %.3f sec\n", fp_build_time);
+    printf("FP-growth mining time: %.3f sec\n", fp_mine_time);
+    return maxk;
+}
+
+// ==================================================
+// Eclat / dEclat (--engine eclat)
+//   パス1の後、DB を縦型 (アイテムごとのトランザクション番号の昇順リスト,
+//   tid-list) に変換し、共通の prefix を持つ同値類ごとに深さ優先で掘る。
+//   頻度は tid-list 同士の共通部分の大きさで求める。
+//   頻出アイテムの平均密度が高いときは dEclat (差分集合, diffset) で持つ:
+//     d(PX)  = t(P) - t(X)        (1段目は tid-list から作る)
+//     d(PXY) = d(PY) - d(PX),  sup(PXY) = sup(PX) - |d(PXY)|
+//   共通部分/差分はソート済み int 列の 4x4 一括比較 (SSE) で求める。
+// ==================================================
+#define ECLAT_DIFFSET_DENSITY 0.5  // 平均密度がこれ以上なら差分集合を使う
+
+struct eclatNode {
+    int item;          // 密なID
+    long long sup;     // prefix + item の頻度
+    int *tids;         // tid-list (差分集合モードでは diffset)
+    long long n;       // tids の長さ
+};
+
+static double eclat_build_time = 0.0;
+static double eclat_mine_time = 0.0;
+static long long eclat_ops = 0;      // 共通部分/差分の計算回数
+static long long eclat_tids = 0;     // 計算で読んだ tid の総数
+static int eclat_diffset = 0;        // 差分集合モードか
+
+// --- スカラー版 (マージ) ---
+static long long intersectScalar(const int *a, long long na, const int *b, long long nb, int *out) {
+    long long i = 0, j = 0, m = 0;
+    while (i < na && j < nb) {
+        if (a[i] < b[j]) i++;
+        else if (a[i] > b[j]) j++;
+        else { out[m++] = a[i]; i++; j++; }
+    }
+    return m;
+}
+static long long differenceScalar(const int *a, long long na, const int *b, long long nb, int *out) {
+    long long i = 0, j = 0, m = 0;
+    while (i < na) {
+        if (j >= nb || a[i] < b[j]) out[m++] = a[i++];
+        else if (a[i] > b[j]) j++;
+        else { i++; j++; }
+    }
+    return m;
+}
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define HAVE_SIMD_TIDLIST 1
+// 4ビットのマスクで選んだ要素を前に詰めるための pshufb 表
+static unsigned char tidShuffle[16][16];
+static int useSimdTidList = 0;
+
+static void initTidShuffle() {
+    for (int m = 0; m < 16; m++) {
+        int o = 0;
+        for (int e = 0; e < 4; e++) {
+            if (!(m & (1 << e))) continue;
+            for (int b = 0; b < 4; b++) tidShuffle[m][o*4 + b] = (unsigned char)(e*4 + b);
+            o++;
+        }
+        for (; o < 4; o++) {
+            for (int b = 0; b < 4; b++) tidShuffle[m][o*4 + b] = 0x80;
+        }
+    }
+    __builtin_cpu_init();
+    useSimdTidList = __builtin_cpu_supports("ssse3");
+}
+
+// va の各要素が vb のどれかと等しいかを 4ビットのマスクで返す (vb を回転させて4回比較)
+__attribute__((target("ssse3")))
+static inline int matchMask4(__m128i va, __m128i vb) {
+    __m128i c = _mm_cmpeq_epi32(va, vb);
+    c = _mm_or_si128(c, _mm_cmpeq_epi32(va, _mm_shuffle_epi32(vb, _MM_SHUFFLE(0,3,2,1))));
+    c = _mm_or_si128(c, _mm_cmpeq_epi32(va, _mm_shuffle_epi32(vb, _MM_SHUFFLE(1,0,3,2))));
+    c = _mm_or_si128(c, _mm_cmpeq_epi32(va, _mm_shuffle_epi32(vb, _MM_SHUFFLE(2,1,0,3))));
+    return _mm_movemask_ps(_mm_castsi128_ps(c));
+}
+
+// a と b の 4個ずつのブロックを比べ、最大値の小さい方 (等しければ両方) を進める
+// out は a と同じ長さ + 3 個の余裕が必要 (端数を含めて4個ずつ書くため)
+__attribute__((target("ssse3")))
+static long long intersectSimd(const int *a, long long na, const int *b, long long nb, int *out) {
+    long long i = 0, j = 0, m = 0;
+    long long na4 = na & ~3LL, nb4 = nb & ~3LL;
+    while (i < na4 && j < nb4) {
+        __m128i va = _mm_loadu_si128((const __m128i*)&a[i]);
+        __m128i vb = _mm_loadu_si128((const __m128i*)&b[j]);
+        int mask = matchMask4(va, vb);
+        __m128i sel = _mm_shuffle_epi8(va, _mm_loadu_si128((const __m128i*)tidShuffle[mask]));
+        _mm_storeu_si128((__m128i*)&out[m], sel);
+        m += __builtin_popcount(mask);
+        int amax = a[i+3], bmax = b[j+3];
+        if (amax <= bmax) i += 4;
+        if (bmax <= amax) j += 4;
+    }
+    return m + intersectScalar(a + i, na - i, b + j, nb - j, out + m);
+}
+
+// a のブロックが b のどのブロックとも一致しなかった要素を、a を進めるときに書き出す
+__attribute__((target("ssse3")))
+static long long differenceSimd(const int *a, long long na, const int *b, long long nb, int *out) {
+    long long i = 0, j = 0, m = 0;
+    long long na4 = na & ~3LL, nb4 = nb & ~3LL;
+    int hit = 0;   // 現在の a ブロックで一致した要素
+    while (i < na4 && j < nb4) {
+        __m128i va = _mm_loadu_si128((const __m128i*)&a[i]);
+        __m128i vb = _mm_loadu_si128((const __m128i*)&b[j]);
+        hit |= matchMask4(va, vb);
+        int amax = a[i+3], bmax = b[j+3];
+        if (amax <= bmax) {
+            int keep = ~hit & 0xF;
+            __m128i sel = _mm_shuffle_epi8(va, _mm_loadu_si128((const __m128i*)tidShuffle[keep]));
+            _mm_storeu_si128((__m128i*)&out[m], sel);
+            m += __builtin_popcount(keep);
+            hit = 0;
+            i += 4;
+        }
+        if (bmax <= amax) j += 4;
+    }
+    // 途中まで比べた a のブロックは、一致済みの要素を除いてスカラーで続ける
+    if (i < na4 && hit) {
+        long long end = i + 4;
+        for (int e = 0; e < 4; e++, i++) {
+            if (hit & (1 << e)) continue;
+            // b[j..) に無ければ残す
+            while (j < nb && b[j] < a[i]) j++;
+            if (j < nb && b[j] == a[i]) { j++; continue; }
+            out[m++] = a[i];
+        }
+        i = end;
+    }
+    return m + differenceScalar(a + i, na - i, b + j, nb - j, out + m);
+}
+#endif
+
+// out = a ∩ b (長さを返す)
+long long intersectTids(const int *a, long long na, const int *b, long long nb, int *out) {
+    eclat_ops++;
+    eclat_tids += na + nb;
+#ifdef HAVE_SIMD_TIDLIST
+    if (useSimdTidList) return intersectSimd(a, na, b, nb, out);
+#endif
+    return intersectScalar(a, na, b, nb, out);
+}
+// out = a - b (長さを返す)
+long long differenceTids(const int *a, long long na, const int *b, long long nb, int *out) {
+    eclat_ops++;
+    eclat_tids += na + nb;
+#ifdef HAVE_SIMD_TIDLIST
+    if (useSimdTidList) return differenceSimd(a, na, b, nb, out);
+#endif
+    return differenceScalar(a, na, b, nb, out);
+}
+
+// 同値類 cls[0..m) (prefix[0..plen) を共通に持つ) を深さ優先で掘る
+//   isDiff: cls の tids が差分集合か
+//   子の同値類と tid-list は eclat_arena から取り、i ごとにまとめて返す
+static struct memArena *eclat_arena = NULL;
+
+void eclatMine(struct eclatNode *cls, int m, int isDiff, int *prefix, int plen,
+               long long total_t, struct mineResult *res) {
+    if (plen >= MAX_ITEMSET_LEN) return;
+    struct arenaMark top = arenaGetMark(eclat_arena);
+    struct eclatNode *child = ARENA_NEW(eclat_arena, struct eclatNode, m > 0 ? m : 1);
+    for (int i = 0; i < m; i++) {
+        prefix[plen] = cls[i].item;
+        recordItemset(res, prefix, plen + 1, cls[i].sup);
+        if (plen + 1 >= MAX_ITEMSET_LEN) continue;
+
+        // prefix+i と prefix+j (j > i) を結合して次の同値類を作る
+        struct arenaMark mark = arenaGetMark(eclat_arena);
+        int nc = 0;
+        int toDiff = isDiff || eclat_diffset;
+        for (int j = i + 1; j < m; j++) {
+            // 結果の長さの上限: 共通部分は短い方、差分は引かれる側
+            long long cap;
+            if (isDiff)       cap = cls[j].n;
+            else if (toDiff)  cap = cls[i].n;
+            else              cap = cls[i].n < cls[j].n ? cls[i].n : cls[j].n;
+            struct arenaMark before = arenaGetMark(eclat_arena);
+            int *buf = ARENA_NEW(eclat_arena, int, cap + 4);
+            long long len, sup;
+            if (isDiff) {
+                len = differenceTids(cls[j].tids, cls[j].n, cls[i].tids, cls[i].n, buf);
+                sup = cls[i].sup - len;
+            } else if (toDiff) {
+                len = differenceTids(cls[i].tids, cls[i].n, cls[j].tids, cls[j].n, buf);
+                sup = cls[i].sup - len;
+            } else {
+                len = intersectTids(cls[i].tids, cls[i].n, cls[j].tids, cls[j].n, buf);
+                sup = len;
+            }
+            if (!isFrequentCount(sup, total_t, MIN_SUPPORT_RATIO)) {
+                arenaRelease(eclat_arena, before);
+                continue;
+            }
+            // 実際の長さまで縮めて、次の tid-list をすぐ後ろに置く
+            arenaTrim(eclat_arena, buf, sizeof(int) * (len > 0 ? len : 1));
+            child[nc].item = cls[j].item;
+            child[nc].sup = sup;
+            child[nc].tids = buf;
+            child[nc].n = len;
+            nc++;
+        }
+        if (nc > 0) eclatMine(child, nc, toDiff, prefix, plen + 1, total_t, res);
+        arenaRelease(eclat_arena, mark);
+    }
+    arenaRelease(eclat_arena, top);
+}
+
+// ---------------------------
+// eclat_generateLk
+//   L1 (パス1の結果、密なID) と DB から縦型 DB を作り、L2..Lk を res に集めて書き出す。
+//   戻り値は出力した最大の k (ルール抽出のため最低でも3)
+// ---------------------------
+int eclat_generateLk(struct tranDB *db, struct itemsetStore *l1, long long total_t, struct mineResult *res) {
+#ifdef HAVE_SIMD_TIDLIST
+    initTidShuffle();
+#endif
+    // 縦型 DB: アイテムごとの tid-list を CSR で作る (tid の昇順)
+    double start = nowSec();
+    int nitems = (int)l1->n;
+    long long *off = (long long*)calloc((size_t)nitems + 1, sizeof(long long));
+    int *tids = (int*)malloc(sizeof(int) * (db->nitems > 0 ? db->nitems : 1));
+    struct eclatNode *cls = (struct eclatNode*)malloc(sizeof(struct eclatNode) * (nitems > 0 ? nitems : 1));
+    if (!off || !tids || !cls) {
+        fprintf(stderr, "Error: malloc failed\n");
+        exit(1);
+    }
+    for (long long p = 0; p < db->nitems; p++) off[db->items[p] + 1]++;
+    for (int x = 0; x < nitems; x++) off[x+1] += off[x];
+    long long *fill = (long long*)malloc(sizeof(long long) * (nitems > 0 ? nitems : 1));
+    if (!fill) {
+        fprintf(stderr, "Error: malloc failed\n");
+        exit(1);
+    }
+    memcpy(fill, off, sizeof(long long) * nitems);
+    for (long long t = 0; t < db->n; t++) {
+        for (long long p = db->offsets[t]; p < db->offsets[t+1]; p++) {
+            tids[fill[db->items[p]]++] = (int)t;
+        }
+    }
+    free(fill);
+
+    // トリム後の DB で頻度を数え直す (パス1後に短いトランザクションを落としているため)
+    int m = 0;
+    double density = 0.0;
+    for (int x = 0; x < nitems; x++) {
+        long long n = off[x+1] - off[x];
+        if (n == 0) continue;
+        cls[m].item = x;
+        cls[m].sup = n;
+        cls[m].tids = &tids[off[x]];
+        cls[m].n = n;
+        density += db->n > 0 ? (double)n / (double)db->n : 0.0;
+        m++;
+    }
+    if (m > 0) density /= m;
+    eclat_diffset = density >= ECLAT_DIFFSET_DENSITY;
+    eclat_build_time += nowSec() - start;
+
+    // マイニング
+    start = nowSec();
+    int prefix[MAX_ITEMSET_LEN];
+    eclat_arena = createArena(ARENA_BLOCK_SIZE);
+    eclatMine(cls, m, 0, prefix, 0, total_t, res);
+    freeArena(eclat_arena);
+    eclat_arena = NULL;
+    free(cls);
+    free(tids);
+    free(off);
+    eclat_mine_time += nowSec() - start;
+
+    int maxk = writeMineResult(res, eclat_diffset ? "dEclat" : "Eclat", total_t);
+    printf("Vertical DB build time: %.3f sec (density %.3f, %s)\n",
+           eclat_build_time, density, eclat_diffset ? "diffsets" : "tid-lists");
+    printf("Eclat mining time: %.3f sec\n", eclat_mine_time);
+    return maxk;
+}
+
+// ==================================================
+// 差分更新 (--save-state FILE / --update FILE)
+//   状態ファイルには、各レベルの候補 C_k = L_k ∪ 負の境界 (頻出でないが
+//   (k-1)部分集合はすべて頻出のアイテムセット) の頻度を元のIDで持ち、
+//   これまでに読んだDBファイル名 (絶対パス)、各ファイルの読んだバイト数とトランザクション数、
+//   総トランザクション数も一緒に置く。読み直すときは保存したバイト数までだけを読むので、
+//   ファイルの末尾に追記 (cat B >> A) してその追記分を --update で与えても二重に数えない。
+//   先頭部分が変わっていればエラーにする。同じファイルを二度 delta として与えるのもエラー。
+//   --update では位置引数のファイルを追加分 (delta) として読み、レベルごとに
+//   apriori-gen で C_k を作って delta で数え、状態にある頻度を足す (FUP)。
+//   状態に無い候補は、負の境界のものが新たに頻出になったときにしか出ないので、
+//   その候補だけを過去のDBファイルを読み直して数える。
+//   --save-state だけなら状態なしから同じ手順で数えて保存する。
+// ==================================================
+#define STATE_MAGIC "KDSTATE2"
+
+struct mineState {
+    long long total_t;      // これまでの総トランザクション数
+    double minsup;          // 作ったときの最小支持度 (参考)
+    int nfiles;
+    char **files;           // これまでに読んだDBファイル (読み直し用)
+    long long *fileBytes;   // 各ファイルの読んだバイト数 (先頭から)
+    long long *fileTrans;   // 各ファイルのトランザクション数
+    int maxk;
+    struct itemsetStore *levels[MAX_ITEMSET_LEN+1];   // C_k と頻度 (元のID)
+};
+static long long state_rescanned = 0;   // 過去のDBで数え直した候補の数
+static int state_rescans = 0;           // 過去のDBを読み直した回数 (レベル数)
+
+void freeMineState(struct mineState *st) {
+    for (int i = 0; i < st->nfiles; i++) free(st->files[i]);
+    free(st->files);
+    free(st->fileBytes);
+    free(st->fileTrans);
+    for (int k = 1; k <= st->maxk; k++) freeItemsetStore(st->levels[k]);
+    memset(st, 0, sizeof(*st));
+}
+void addStateFile(struct mineState *st, const char *file, long long bytes, long long trans) {
+    char **t = (char**)realloc(st->files, sizeof(char*) * (st->nfiles + 1));
+    if (t) st->files = t;
+    long long *b = (long long*)realloc(st->fileBytes, sizeof(long long) * (st->nfiles + 1));
+    if (b) st->fileBytes = b;
+    long long *n = (long long*)realloc(st->fileTrans, sizeof(long long) * (st->nfiles + 1));
+    if (n) st->fileTrans = n;
+    char *f = strdup(file);
+    if (!t || !b || !n || !f) {
+        fprintf(stderr, "Error: malloc failed\n");
+        exit(1);
+    }
+    st->files[st->nfiles] = f;
+    st->fileBytes[st->nfiles] = bytes;
+    st->fileTrans[st->nfiles] = trans;
+    st->nfiles++;
+}
+
+// 状態に置くDBファイル名。別のディレクトリから --update しても読み直せるよう絶対パスにする
+// (解決できなければそのまま)。戻り値は free する
+static char* stateFilePath(const char *file) {
+#if defined(_WIN32)
+    char *p = _fullpath(NULL, file, 0);
+#else
+    char *p = realpath(file, NULL);
+#endif
+    if (!p) p = strdup(file);
+    if (!p) {
+        fprintf(stderr, "Error: malloc failed\n");
+        exit(1);
+    }
+    return p;
+}
+
+static void stateRead(void *p, size_t size, size_t n, FILE *fp, const char *filename) {
+    if (fread(p, size, n, fp) != n) {
+        fprintf(stderr, "Error: %s is truncated\n", filename);
+        exit(1);
+    }
+}
+static void stateWrite(const void *p, size_t size, size_t n, FILE *fp, const char *filename) {
+    if (fwrite(p, size, n, fp) != n) {
+        fprintf(stderr, "Error: write failed for %s\n", filename);
+        exit(1);
+    }
+}
+// [magic 8][maxk int32][nfiles int32][total_t int64][minsup double]
+// [ファイル: 名前の長さ int32 + 名前, バイト数 int64, トランザクション数 int64] * nfiles
+// [k=1..maxk: n int64, アイテム n*k int32, 頻度 n int64]
+void saveState(const char *filename, const struct mineState *st) {
+    FILE *fp = fopen(filename, "wb");
+    if (!fp) {
+        fprintf(stderr, "Error: cannot open %s for writing\n", filename);
+        exit(1);
+    }
+    int32_t maxk = st->maxk, nfiles = st->nfiles;
+    int64_t total_t = st->total_t;
+    stateWrite(STATE_MAGIC, 1, 8, fp, filename);
+    stateWrite(&maxk, sizeof(maxk), 1, fp, filename);
+    stateWrite(&nfiles, sizeof(nfiles), 1, fp, filename);
+    stateWrite(&total_t, sizeof(total_t), 1, fp, filename);
+    stateWrite(&st->minsup, sizeof(double), 1, fp, filename);
+    for (int i = 0; i < st->nfiles; i++) {
+        int32_t len = (int32_t)strlen(st->files[i]);
+        stateWrite(&len, sizeof(len), 1, fp, filename);
+        stateWrite(st->files[i], 1, len, fp, filename);
+        int64_t bytes = st->fileBytes[i], trans = st->fileTrans[i];
+        stateWrite(&bytes, sizeof(bytes), 1, fp, filename);
+        stateWrite(&trans, sizeof(trans), 1, fp, filename);
+    }
+    for (int k = 1; k <= st->maxk; k++) {
+        const struct itemsetStore *s = st->levels[k];
+        int64_t n = s->n;
+        stateWrite(&n, sizeof(n), 1, fp, filename);
+        stateWrite(s->items, sizeof(int), (size_t)n * k, fp, filename);
+        stateWrite(s->counts, sizeof(long long), (size_t)n, fp, filename);
+    }
+    fclose(fp);
+}
+void loadState(const char *filename, struct mineState *st) {
+    FILE *fp = fopen(filename, "rb");
+    if (!fp) {
+        fprintf(stderr, "Error: cannot open %s\n", filename);
+        exit(1);
+    }
+    char magic[8];
+    int32_t maxk, nfiles;
+    int64_t total_t;
+    stateRead(magic, 1, 8, fp, filename);
+    if (memcmp(magic, STATE_MAGIC, 8) != 0) {
+        fprintf(stderr, "Error: %s is not a state file\n", filename);
+        exit(1);
+    }
+    stateRead(&maxk, sizeof(maxk), 1, fp, filename);
+    stateRead(&nfiles, sizeof(nfiles), 1, fp, filename);
+    stateRead(&total_t, sizeof(total_t), 1, fp, filename);
+    stateRead(&st->minsup, sizeof(double), 1, fp, filename);
+    if (maxk < 1 || maxk > MAX_ITEMSET_LEN || nfiles < 0 || total_t < 0) {
+        fprintf(stderr, "Error: %s is not a state file\n", filename);
+        exit(1);
+    }
+    st->total_t = total_t;
+    for (int i = 0; i < nfiles; i++) {
+        int32_t len;
+        stateRead(&len, sizeof(len), 1, fp, filename);
+        char *f = (char*)malloc(len > 0 ? len + 1 : 1);
+        if (!f || len < 0) {
+            fprintf(stderr, "Error: %s is not a state file\n", filename);
+            exit(1);
+        }
+        stateRead(f, 1, len, fp, filename);
+        f[len] = '\0';
+        int64_t bytes, trans;
+        stateRead(&bytes, sizeof(bytes), 1, fp, filename);
+        stateRead(&trans, sizeof(trans), 1, fp, filename);
+        if (bytes < 0 || trans < 0) {
+            fprintf(stderr, "Error: %s is not a state file\n", filename);
+            exit(1);
+        }
+        addStateFile(st, f, bytes, trans);
+        free(f);
+    }
+    int set[MAX_ITEMSET_LEN];
+    for (int k = 1; k <= maxk; k++) {
+        int64_t n;
+        stateRead(&n, sizeof(n), 1, fp, filename);
+        if (n < 0) {
+            fprintf(stderr, "Error: %s is not a state file\n", filename);
+            exit(1);
+        }
+        int *items = (int*)malloc(sizeof(int) * k * (n > 0 ? n : 1));
+        long long *counts = (long long*)malloc(sizeof(long long) * (n > 0 ? n : 1));
+        if (!items || !counts) {
+            fprintf(stderr, "Error: malloc failed\n");
+            exit(1);
+        }
+        stateRead(items, sizeof(int), (size_t)n * k, fp, filename);
+        stateRead(counts, sizeof(long long), (size_t)n, fp, filename);
+        st->levels[k] = createItemsetStore(k, n);
+        for (long long i = 0; i < n; i++) {
+            memcpy(set, &items[i * k], sizeof(int) * k);
+            insertItemset(st->levels[k], set, counts[i]);
+        }
+        free(items);
+        free(counts);
+    }
+    st->maxk = maxk;
+    fclose(fp);
+}
+
+// 状態にある C_k の頻度 (元のID)。無ければ -1
+static long long stateCount(const struct mineState *st, int k, const int *orig) {
+    if (k > st->maxk || !st->levels[k]) return -1;
+    long long probes = 0;
+    long long p = findItemset(st->levels[k], orig, &probes);
+    return p >= 0 ? st->levels[k]->counts[p] : -1;
+}
+// 過去のDBファイルを読み直して u の頻度を数える (u は密なID)。
+// 各ファイルは状態を作ったときに読んだ先頭部分だけを読み、中身が変わっていればエラー
+static void rescanOldFiles(const struct mineState *st, struct itemsetStore *l1, struct itemsetStore *u) {
+    for (int i = 0; i < st->nfiles; i++) {
+        struct tranDB *old = loadTransactionsPrefix(st->files[i], st->fileBytes[i]);
+        if (old->n != st->fileTrans[i]) {
+            fprintf(stderr, "Error: %s has changed since the state was saved "
+                    "(%lld transactions, expected %lld)\n", st->files[i], old->n, st->fileTrans[i]);
+            exit(1);
+        }
+        remapTransactions(old);
+        int *tranLen = countCandidatesAuto(old, l1, u);
+        free(tranLen);
+        freeTransactions(old);
+    }
+}
+
+// 追加分 db (元のID) と状態 st から L1..Lk を求めて res に入れ、st を新しい状態にする。
+// 戻り値は最大の k。*total_t には過去分と合わせた総トランザクション数を返す
+int updateGenerateLk(struct tranDB *db, const char *delta_file, struct mineState *st,
+                     long long *total_t, struct mineResult *res) {
+    double start = nowSec();
+    long long N = st->total_t + db->n;
+    char *delta_path = stateFilePath(delta_file);
+    for (int i = 0; i < st->nfiles; i++) {
+        if (strcmp(st->files[i], delta_path) == 0) {
+            fprintf(stderr, "Error: %s is already counted in the state; "
+                    "append new transactions to another file\n", delta_file);
+            exit(1);
+        }
+    }
+
+    // L1: delta の頻度に状態の頻度を足す (状態にないアイテムは過去に現れていない)
+    initItemHash(db->nitems < ITEM_PRESIZE ? db->nitems : ITEM_PRESIZE);
+    for (long long i = 0; i < db->nitems; i++) {
+        insertOrUpdateItem(db->items[i]);
+    }
+    if (st->maxk >= 1) {
+        for (long long i = 0; i < st->levels[1]->n; i++) {
+            addItemCount(st->levels[1]->items[i], st->levels[1]->counts[i]);
+        }
+    }
+    struct mineState next;
+    memset(&next, 0, sizeof(next));
+    next.total_t = N;
+    next.minsup = MIN_SUPPORT_RATIO;
+    for (int i = 0; i < st->nfiles; i++) {
+        addStateFile(&next, st->files[i], st->fileBytes[i], st->fileTrans[i]);
+    }
+    addStateFile(&next, delta_path, db->bytes, db->n);
+    free(delta_path);
+    next.levels[1] = createItemsetStore(1, itemHash.n);
+    struct remapEntry *freq = (struct remapEntry*)malloc(sizeof(struct remapEntry) * (itemHash.n > 0 ? itemHash.n : 1));
+    if (!freq) {
+        fprintf(stderr, "Error: malloc failed\n");
+        exit(1);
+    }
+    int nfreq = 0;
+    for (long long h = 0; h < itemHash.n; h++) {
+        insertItemset(next.levels[1], &itemHash.items[h], itemHash.counts[h]);
+        if (isFrequentCount(itemHash.counts[h], N, MIN_SUPPORT_RATIO)) {
+            freq[nfreq].item = itemHash.items[h];
+            freq[nfreq].count = itemHash.counts[h];
+            nfreq++;
+        }
+    }
+    next.maxk = 1;
+    freeItemHash();
+    struct itemsetStore *l1 = remapItems(db, freq, nfreq);
+    free(freq);
+    trimTransactions(db, l1, NULL);
+    writeLevelFile(l1, N);
+    res->levels[1] = l1;
+    pass_time[1] += nowSec() - start;
+
+    char filename[64];
+    levelFileName(1, filename, sizeof(filename));
+    printf("=== Update pass1 -> %s ===\n", filename);
+    printf("Total transactions: %lld (previous %lld + new %lld)\n", N, st->total_t, N - st->total_t);
+    printf("Pass1 time: %.3f sec\n", pass_time[1]);
+
+    // L2..: C_k を delta で数え、状態の頻度を足す。状態に無いものだけ過去のDBで数える
+    struct itemsetStore *prev = l1;
+    int maxk = 1;
+    int orig[MAX_ITEMSET_LEN];
+    for (int k = 2; k <= MAX_ITEMSET_LEN; k++) {
+        if (prev->n == 0 && k > 3) break;
+        start = nowSec();
+        struct itemsetStore *c = generateCandidates(prev);
+        int *tranLen = countCandidatesAuto(db, l1, c);
+
+        struct itemsetStore *u = createItemsetStore(k, 0);
+        long long *upos = (long long*)malloc(sizeof(long long) * (c->n > 0 ? c->n : 1));
+        if (!upos) {
+            fprintf(stderr, "Error: malloc failed\n");
+            exit(1);
+        }
+        for (long long i = 0; i < c->n; i++) {
+            toOrigItems(&c->items[i * k], k, orig);
+            long long old = stateCount(st, k, orig);
+            if (old >= 0) {
+                c->counts[i] += old;
+            } else {
+                upos[u->n] = i;
+                insertItemset(u, &c->items[i * k], 0);
+            }
+        }
+        if (u->n > 0 && st->nfiles > 0) {
+            rescanOldFiles(st, l1, u);
+            for (long long j = 0; j < u->n; j++) {
+                c->counts[upos[j]] += u->counts[j];
+            }
+            state_rescanned += u->n;
+            state_rescans++;
+        }
+        free(upos);
+        freeItemsetStore(u);
+
+        // 新しい状態の C_k (元のID)
+        next.levels[k] = createItemsetStore(k, c->n);
+        for (long long i = 0; i < c->n; i++) {
+            toOrigItems(&c->items[i * k], k, orig);
+            insertItemset(next.levels[k], orig, c->counts[i]);
+        }
+        next.maxk = k;
+
+        struct itemsetStore *l = extractFrequent(c, N);
+        freeItemsetStore(c);
+        trimTransactions(db, l, tranLen);
+        free(tranLen);
+        writeLevelFile(l, N);
+        res->levels[k] = l;
+        res->maxk = k;
+        prev = l;
+        maxk = k;
+        pass_time[k] += nowSec() - start;
+
+        levelFileName(k, filename, sizeof(filename));
+        printf("=== Update pass%d -> %s ===\n", k, filename);
+        if (k == 2)      printf("Found %lld frequent pairs\n", l->n);
+        else if (k == 3) printf("Found %lld frequent triples\n", l->n);
+        else             printf("Found %lld frequent %d-itemsets\n", l->n, k);
+        printf("Pass%d time: %.3f sec\n", k, pass_time[k]);
+    }
+    printf("Rescanned old data for %lld candidates (%d levels)\n", state_rescanned, state_rescans);
+
+    freeMineState(st);
+    *st = next;
+    *total_t = N;
+    return maxk;
+}
+
+// ==================================================
+// 元のIDで求めた L1..Lk の書き出し (スライディングウィンドウ / ストリーム)
+//   L1 に頻度の降順で密なIDを振り直し (assignDenseIds)、L2.. を密なIDに直して
+//   Lk ファイルに書き出す。以降のルール抽出は通常と同じ。
+// ==================================================
+
+// 元のIDの L_k を、いまの密なIDの L_k に直す (dense は元のID → 密なID の表)
+static struct itemsetStore* toDenseLevel(struct itemsetStore *l, struct itemsetStore *dense) {
+    int k = l->k;
+    struct itemsetStore *d = createItemsetStore(k, l->n);
+    int set[MAX_ITEMSET_LEN];
+    long long probes = 0;
+    for (long long i = 0; i < l->n; i++) {
+        for (int j = 0; j < k; j++) {
+            set[j] = (int)findItemset(dense, &l->items[i * k + j], &probes);
+        }
+        sortItems(set, k);
+        insertItemset(d, set, l->counts[i]);
+    }
+    sortItemsetStore(d);
+    return d;
+}
+// lv[1..maxk] (元のID、昇順) を書き出す。res があれば密なIDの L1..Lk を res に入れ、
+// 無ければ書き出した後で捨てる。通常の Apriori と同じく L3 までは空でも書く
+// (maxk より長いものは、その手前が空のときだけ空として書く)。戻り値は書き出した最大の k
+int publishOrigLevels(struct itemsetStore **lv, int maxk, long long total_t, struct mineResult *res) {
+    struct remapEntry *freq = (struct remapEntry*)malloc(sizeof(struct remapEntry) * (lv[1]->n > 0 ? lv[1]->n : 1));
+    if (!freq) {
+        fprintf(stderr, "Error: malloc failed\n");
+        exit(1);
+    }
+    for (long long i = 0; i < lv[1]->n; i++) {
+        freq[i].item = lv[1]->items[i];
+        freq[i].count = lv[1]->counts[i];
+    }
+    struct itemsetStore *prev = assignDenseIds(freq, (int)lv[1]->n);
+    free(freq);
+    struct itemsetStore *dense = createItemsetStore(1, prev->n);
+    for (long long i = 0; i < prev->n; i++) {
+        insertItemset(dense, &origItemId[i], 0);
+    }
+    writeLevelFile(prev, total_t);
+    if (res) res->levels[1] = prev;
+    int top = 1;
+    for (int k = 2; k <= MAX_ITEMSET_LEN; k++) {
+        if ((prev->n == 0 && k > 3) || (k > maxk && prev->n > 0)) break;
+        struct itemsetStore *l = k <= maxk ? toDenseLevel(lv[k], dense) : createItemsetStore(k, 0);
+        writeLevelFile(l, total_t);
+        if (res) {
+            res->levels[k] = l;
+            res->maxk = k;
+        } else {
+            freeItemsetStore(prev);
+        }
+        prev = l;
+        top = k;
+    }
+    if (!res) freeItemsetStore(prev);
+    freeItemsetStore(dense);
+    return top;
+}
+
+// ==================================================
+// スライディングウィンドウ (--window N [--slide S])
+//   DB はほかのモードと同じく先に全体を CSR に読み込んでおき、そこから
+//   S 件ずつウィンドウに流し込んで、直近 N 件だけを見て
+//   頻出アイテムセットを保つ。各アイテムはウィンドウ内の位置 (t mod N) の
+//   ビット列を持ち、見張っているアイテムセット C_k (= L_k ∪ 負の境界) の
+//   頻度は、入ってくる S 件と出ていく S 件の位置だけ AND + popcount して
+//   足し引きする (ウィンドウ全体を読み直さない)。
+//   頻出かどうかが変わったものがあるときだけ、L_{k-1} から C_k を作り直す。
+//   見張っていなかった候補の頻度は、ビット列全体の AND で求める。
+//   ウィンドウから出て頻度が 0 になったアイテムは C_1 から外し、そのビット列の行は
+//   空き行として次に現れたアイテムに使い回す。消す・数えるのはいる行だけなので、
+//   新しいIDが出続けても、メモリとスライドごとの手間はウィンドウ内のアイテム数で決まる。
+//   スライドごとに、頻出になったもの (+) と外れたもの (-) を表示する。
+// ==================================================
+static long long WINDOW_SIZE = 0;     // 0 ならウィンドウなし
+static long long WINDOW_SLIDE = 0;    // 0 なら N/10
+static long long window_slides = 0;
+static long long window_rebuilds = 0;
+static long long window_fresh = 0;    // 作り直しでウィンドウ全体から数えた候補の数
+static long long window_words = 0;    // AND + popcount した 64bit 語の数
+static double window_time = 0.0;
+
+struct slidingWindow {
+    long long N, W;                 // ウィンドウの件数と1行の語数
+    uint64_t *bits;                 // アイテムごとのビット列 (rowsCap 行)
+    long long rowsCap, rowsUsed;
+    long long *freeRows;            // 空いた行 (ビットはすべて 0)
+    long long nfree;
+    long long *row;                 // C_1 の各アイテムのビット列の行
+    long long c1Cap;                // row と freq[1] の大きさ
+    struct itemsetStore *levels[MAX_ITEMSET_LEN+1];   // C_k (元のID、昇順)
+    char *freq[MAX_ITEMSET_LEN+1];  // C_k の各セットがいま頻出か
+    int maxk;
+};
+
+// C_1 の r 番目のアイテムのビット列
+static inline uint64_t* windowBits(const struct slidingWindow *sw, long long r) {
+    return sw->bits + sw->row[r] * sw->W;
+}
+// C_1 にアイテムを足し、ビット列の行を (空き行があればそれを) 割り当てて C_1 の添字を返す
+static long long windowItemRow(struct slidingWindow *sw, int item) {
+    long long probes = 0;
+    long long r = findItemset(sw->levels[1], &item, &probes);
+    if (r >= 0) return r;
+    r = insertItemset(sw->levels[1], &item, 0);
+    if (r >= sw->c1Cap) {
+        long long cap = sw->c1Cap > 0 ? sw->c1Cap * 2 : 256;
+        long long *rw = (long long*)realloc(sw->row, sizeof(long long) * cap);
+        if (rw) sw->row = rw;
+        char *f = (char*)realloc(sw->freq[1], cap);
+        if (!rw || !f) {
+            fprintf(stderr, "Error: realloc failed\n");
+            exit(1);
+        }
+        memset(f + sw->c1Cap, 0, cap - sw->c1Cap);
+        sw->freq[1] = f;
+        sw->c1Cap = cap;
+    }
+    sw->freq[1][r] = 0;
+    if (sw->nfree > 0) {
+        sw->row[r] = sw->freeRows[--sw->nfree];
+        return r;
+    }
+    if (sw->rowsUsed >= sw->rowsCap) {
+        long long cap = sw->rowsCap > 0 ? sw->rowsCap * 2 : 256;
+        uint64_t *t = (uint64_t*)realloc(sw->bits, sizeof(uint64_t) * cap * sw->W);
+        if (t) sw->bits = t;
+        long long *fr = (long long*)realloc(sw->freeRows, sizeof(long long) * cap);
+        if (!t || !fr) {
+            fprintf(stderr, "Error: realloc failed\n");
+            exit(1);
+        }
+        memset(t + sw->rowsCap * sw->W, 0, sizeof(uint64_t) * (cap - sw->rowsCap) * sw->W);
+        sw->freeRows = fr;
+        sw->rowsCap = cap;
+    }
+    sw->row[r] = sw->rowsUsed++;
+    return r;
+}
+// ウィンドウ内の頻度が 0 になったアイテムを C_1 から外し、行を空き行に戻す。
+// 頻出でない C_1 のアイテムは C_k (k >= 2) に現れないので、作り直しの後に呼べば C_k はそのまま
+static void windowDropDead(struct slidingWindow *sw) {
+    struct itemsetStore *c1 = sw->levels[1];
+    long long dead = 0;
+    for (long long i = 0; i < c1->n; i++) dead += c1->counts[i] == 0 && !sw->freq[1][i];
+    if (dead == 0) return;
+    struct itemsetStore *live = createItemsetStore(1, c1->n - dead);
+    for (long long i = 0; i < c1->n; i++) {
+        if (c1->counts[i] == 0 && !sw->freq[1][i]) {
+            sw->freeRows[sw->nfree++] = sw->row[i];
+            continue;
+        }
+        // 前から詰めるので、書き込む位置 j は i 以下
+        long long j = insertItemset(live, &c1->items[i], c1->counts[i]);
+        sw->row[j] = sw->row[i];
+        sw->freq[1][j] = sw->freq[1][i];
+    }
+    freeItemsetStore(c1);
+    sw->levels[1] = live;
+}
+// c の各セットについて、アイテムがすべて立っている位置を [lo, hi) の中で数え、
+// sign 倍して counts に足す (todo があれば todo[i] が 0 のものは飛ばす)。
+// C_k は辞書順なので、先頭 k-1 個が等しい間は prefix の AND を使い回す
+static void windowCountStore(struct slidingWindow *sw, struct itemsetStore *c, long long lo, long long hi,
+                             long long sign, const char *todo) {
+    int k = c->k;
+    long long w0 = lo >> 6, nw = ((hi - 1) >> 6) - w0 + 1;
+    uint64_t *pre = (uint64_t*)malloc(sizeof(uint64_t) * nw);
+    if (!pre) {
+        fprintf(stderr, "Error: malloc failed\n");
+        exit(1);
+    }
+    const int *prevSet = NULL;
+    int preOk = 0;
+    long long probes = 0;
+    for (long long i = 0; i < c->n; i++) {
+        if (todo && !todo[i]) continue;
+        const int *set = &c->items[i * k];
+        if (!prevSet || memcmp(prevSet, set, sizeof(int) * (k - 1)) != 0) {
+            for (long long w = 0; w < nw; w++) pre[w] = ~0ULL;
+            pre[0] &= ~0ULL << (lo & 63);
+            if (hi & 63) pre[nw - 1] &= ~0ULL >> (64 - (hi & 63));
+            preOk = 1;
+            for (int j = 0; j < k - 1; j++) {
+                long long r = findItemset(sw->levels[1], &set[j], &probes);
+                if (r < 0) {
+                    preOk = 0;
+                    break;
+                }
+                const uint64_t *row = windowBits(sw, r) + w0;
+                for (long long w = 0; w < nw; w++) pre[w] &= row[w];
+            }
+            prevSet = set;
+        }
+        if (!preOk) continue;
+        long long r = findItemset(sw->levels[1], &set[k - 1], &probes);
+        if (r < 0) continue;
+        c->counts[i] += sign * (long long)andPopcount(pre, windowBits(sw, r) + w0, nw);
+        window_words += nw;
+    }
+    free(pre);
+}
+// 位置 [lo, hi) の分の頻度をすべての C_k に sign 倍して足す
+static void windowAddRange(struct slidingWindow *sw, long long lo, long long hi, int sign) {
+    for (int k = 1; k <= sw->maxk; k++) {
+        windowCountStore(sw, sw->levels[k], lo, hi, sign, NULL);
+    }
+}
+// トランザクション t をウィンドウの位置 t mod N に入れる (ビットは消してある前提)
+static void windowInsert(struct slidingWindow *sw, struct tranDB *db, long long t) {
+    long long pos = t % sw->N;
+    for (long long i = db->offsets[t]; i < db->offsets[t+1]; i++) {
+        long long r = windowItemRow(sw, db->items[i]);
+        windowBits(sw, r)[pos >> 6] |= 1ULL << (pos & 63);
+    }
+}
+void freeSlidingWindow(struct slidingWindow *sw) {
+    for (int k = 1; k <= sw->maxk; k++) {
+        freeItemsetStore(sw->levels[k]);
+        free(sw->freq[k]);
+    }
+    free(sw->bits);
+    free(sw->freeRows);
+    free(sw->row);
+    memset(sw, 0, sizeof(*sw));
+}
+// 位置 [lo, hi) のビットを C_1 にいるアイテムの行で消す (空き行はもともと 0)
+static void windowClearRange(struct slidingWindow *sw, long long lo, long long hi) {
+    long long w0 = lo >> 6, w1 = (hi - 1) >> 6;
+    uint64_t first = ~0ULL << (lo & 63);
+    uint64_t last = (hi & 63) ? ~0ULL >> (64 - (hi & 63)) : ~0ULL;
+    for (long long r = 0; r < sw->levels[1]->n; r++) {
+        uint64_t *row = windowBits(sw, r);
+        for (long long w = w0; w <= w1; w++) {
+            uint64_t m = ~0ULL;
+            if (w == w0) m &= first;
+            if (w == w1) m &= last;
+            row[w] &= ~m;
+        }
+    }
+}
+static void printWindowChange(char sign, const int *set, int k, long long count, long long n) {
+    printf("%c {", sign);
+    for (int j = 0; j < k; j++) printf(j ? ", %d" : "%d", set[j]);
+    printf("} count=%lld support=%.4f\n", count, (double)count / (double)n);
+}
+// C_k の頻出なものを昇順の L_k として取り出す
+static struct itemsetStore* windowFrequent(struct slidingWindow *sw, int k) {
+    struct itemsetStore *c = sw->levels[k];
+    struct itemsetStore *l = createItemsetStore(k, 0);
+    for (long long i = 0; i < c->n; i++) {
+        if (sw->freq[k][i]) insertItemset(l, &c->items[i * k], c->counts[i]);
+    }
+    sortItemsetStore(l);
+    return l;
+}
+// 頻出かどうかの印を付け直し、変わったものがあれば 1
+static int windowRefreshFlags(struct slidingWindow *sw, long long n, double minsup) {
+    int changed = 0;
+    for (int k = 1; k <= sw->maxk; k++) {
+        struct itemsetStore *c = sw->levels[k];
+        for (long long i = 0; i < c->n; i++) {
+            char f = (char)isFrequentCount(c->counts[i], n, minsup);
+            if (f != sw->freq[k][i]) changed = 1;
+        }
+    }
+    return changed;
+}
+// L_{k-1} から C_k (k >= 2) を作り直す。見張っていた候補の頻度はそのまま使い、
+// 新しい候補だけビット列全体から数える。頻出かどうかは minsup で決める。
+// report なら出入りしたものを表示する
+static void windowRebuild(struct slidingWindow *sw, long long n, double minsup, int report) {
+    window_rebuilds++;
+    struct itemsetStore *oldL[MAX_ITEMSET_LEN+1];
+    memset(oldL, 0, sizeof(oldL));
+    for (int k = 1; k <= sw->maxk && report; k++) oldL[k] = windowFrequent(sw, k);
+    int oldMaxk = sw->maxk;
+
+    struct itemsetStore *c1 = sw->levels[1];
+    for (long long i = 0; i < c1->n; i++) {
+        sw->freq[1][i] = (char)isFrequentCount(c1->counts[i], n, minsup);
+    }
+    struct itemsetStore *prev = windowFrequent(sw, 1);
+    int maxk = 1;
+    for (int k = 2; k <= MAX_ITEMSET_LEN && prev->n > 0; k++) {
+        struct itemsetStore *c = generateCandidates(prev);
+        char *f = (char*)malloc(c->n > 0 ? c->n : 1);
+        if (!f) {
+            fprintf(stderr, "Error: malloc failed\n");
+            exit(1);
+        }
+        char *todo = (char*)malloc(c->n > 0 ? c->n : 1);
+        if (!todo) {
+            fprintf(stderr, "Error: malloc failed\n");
+            exit(1);
+        }
+        long long probes = 0, fresh = 0;
+        for (long long i = 0; i < c->n; i++) {
+            long long p = k <= sw->maxk ? findItemset(sw->levels[k], &c->items[i * k], &probes) : -1;
+            c->counts[i] = p >= 0 ? sw->levels[k]->counts[p] : 0;
+            todo[i] = p < 0;
+            fresh += p < 0;
+        }
+        if (fresh > 0) windowCountStore(sw, c, 0, sw->N, 1, todo);
+        window_fresh += fresh;
+        free(todo);
+        for (long long i = 0; i < c->n; i++) {
+            f[i] = (char)isFrequentCount(c->counts[i], n, minsup);
+        }
+        if (prev != NULL) freeItemsetStore(prev);
+        if (k <= sw->maxk) {
+            freeItemsetStore(sw->levels[k]);
+            free(sw->freq[k]);
+        }
+        sw->levels[k] = c;
+        sw->freq[k] = f;
+        maxk = k;
+        prev = windowFrequent(sw, k);
+    }
+    freeItemsetStore(prev);
+    for (int k = maxk + 1; k <= sw->maxk; k++) {
+        freeItemsetStore(sw->levels[k]);
+        free(sw->freq[k]);
+        sw->levels[k] = NULL;
+        sw->freq[k] = NULL;
+    }
+    sw->maxk = maxk;
+
+    // 出入りの表示 (長さごとに、入ったもの → 出たもの)
+    if (!report) return;
+    int top = maxk > oldMaxk ? maxk : oldMaxk;
+    long long probes = 0;
+    for (int k = 1; k <= top; k++) {
+        struct itemsetStore *now = k <= maxk ? windowFrequent(sw, k) : createItemsetStore(k, 0);
+        for (long long i = 0; i < now->n; i++) {
+            if (!oldL[k] || findItemset(oldL[k], &now->items[i * k], &probes) < 0) {
+                printWindowChange('+', &now->items[i * k], k, now->counts[i], n);
+            }
+        }
+        for (long long i = 0; oldL[k] && i < oldL[k]->n; i++) {
+            if (findItemset(now, &oldL[k]->items[i * k], &probes) < 0) {
+                printWindowChange('-', &oldL[k]->items[i * k], k, oldL[k]->counts[i], n);
+            }
+        }
+        freeItemsetStore(now);
+        freeItemsetStore(oldL[k]);
+    }
+}
+
+// db (元のID) を先頭から流し、最後のウィンドウの L1..Lk を res に入れて書き出す。
+// 戻り値は最大の k、*total_t は最後のウィンドウの件数
+int windowGenerateLk(struct tranDB *db, long long *total_t, struct mineResult *res) {
+    double start = nowSec();
+    initPopcount();
+    struct slidingWindow sw;
+    memset(&sw, 0, sizeof(sw));
+    sw.N = WINDOW_SIZE;
+    sw.W = (sw.N + 63) / 64;
+    sw.levels[1] = createItemsetStore(1, ITEM_PRESIZE);
+    sw.maxk = 1;
+    long long S = WINDOW_SLIDE > 0 ? WINDOW_SLIDE : (sw.N / 10 > 0 ? sw.N / 10 : 1);
+    if (S > sw.N) S = sw.N;
+
+    long long n = 0;
+    for (long long from = 0; from < db->n; from += S) {
+        long long to = from + S < db->n ? from + S : db->n;
+        // 入れ替わる位置 [from, to) mod N (折り返すときは2つの区間)
+        long long lo[2], hi[2];
+        int nr = 0;
+        long long p = from % sw.N, q = p + (to - from);
+        if (q <= sw.N) {
+            lo[nr] = p; hi[nr++] = q;
+        } else {
+            lo[nr] = p; hi[nr++] = sw.N;
+            lo[nr] = 0; hi[nr++] = q - sw.N;
+        }
+        // 出ていく分を引いて消し、入ってくる分を立てて足す
+        if (to > sw.N) {
+            for (int r = 0; r < nr; r++) {
+                windowAddRange(&sw, lo[r], hi[r], -1);
+                windowClearRange(&sw, lo[r], hi[r]);
+            }
+        }
+        for (long long t = from; t < to; t++) windowInsert(&sw, db, t);
+        for (int r = 0; r < nr; r++) windowAddRange(&sw, lo[r], hi[r], +1);
+        n = to < sw.N ? to : sw.N;
+        window_slides++;
+
+        if (windowRefreshFlags(&sw, n, MIN_SUPPORT_RATIO)) {
+            printf("=== Window %lld..%lld (%lld transactions) ===\n", to - n + 1, to, n);
+            windowRebuild(&sw, n, MIN_SUPPORT_RATIO, 1);
+        }
+        windowDropDead(&sw);
+    }
+
+    // 最後のウィンドウの L_k を密なIDに直して書き出す (以降は通常と同じ)
+    struct itemsetStore *lv[MAX_ITEMSET_LEN+1];
+    for (int k = 1; k <= sw.maxk; k++) lv[k] = windowFrequent(&sw, k);
+    int maxk = publishOrigLevels(lv, sw.maxk, n, res);
+    for (int k = 1; k <= sw.maxk; k++) freeItemsetStore(lv[k]);
+    freeSlidingWindow(&sw);
+
+    window_time += nowSec() - start;
+    char filename[64];
+    for (int k = 1; k <= maxk; k++) {
+        levelFileName(k, filename, sizeof(filename));
+        printf("=== Window -> %s ===\n", filename);
+        printf("Found %lld frequent %d-itemsets\n", res->levels[k]->n, k);
+    }
+    printf("Window: last %lld of %lld transactions, %lld slides, %lld rebuilds\n",
+           n, db->n, window_slides, window_rebuilds);
+    *total_t = n;
+    return maxk;
+}
+
+// ==================================================
+// ストリーム (--stream EPS)
+//   <transaction_file> を 1回だけ読み (- なら標準入力)、Lossy Counting で
+//   アイテム・ペア・トリプルの頻度を近似する。幅 w = ceil(1/EPS) のバケットごとに
+//   f + Δ <= (バケット番号) の項目を捨てるので、表の大きさはストリームの長さに
+//   ほぼよらない (1/EPS * log(EPS*N) 程度)。
+//   ペア・トリプルは、(k-1)部分集合がすべてこのトランザクションより前から表にあるときだけ
+//   入れる (SetGen と同じ枝刈り)。長いトランザクションが初めて来ても、部分集合を
+//   すべて列挙して表が長さの3乗で膨らむことはない。そのぶん取りこぼしの上限は
+//   長さごとに1ずつ増え、Δ は min(b - 2 + k, 部分集合の f + Δ の最小) にする。
+//   出力するのは f >= (minsup - EPS) * N - (k - 1) のもの。本当の頻度は f 以上
+//   f + EPS*N + (k - 1) 以下。本当の頻度が EPS*N + (k - 1) を超えるものは必ず表にあるので、
+//   (minsup - EPS) * N >= k になる長さまで読めば、支持度が minsup 以上のものは必ず含まれる
+//   (それより短いうちは、まだ表に入っていない低頻度のものを取りこぼしうる)。
+//   --snapshot M を付けると M 件ごとにその時点の L1..L3 を Lk ファイルに書き出す。
+// ==================================================
+#define STREAM_MAX_K 3
+static double STREAM_EPSILON = 0.0;    // 0 ならストリームなし
+static long long STREAM_SNAPSHOT = 0;  // 0 なら最後にだけ書き出す
+static long long stream_snapshots = 0;
+static long long stream_pruned = 0;        // バケットの境目で捨てた項目の数
+static long long stream_entries_peak = 0;  // 表の項目数の最大値 (全長さの合計)
+static double stream_time = 0.0;
+
+struct lossyCounter {
+    long long n;        // 読んだトランザクション数
+    long long width;    // バケット幅 ceil(1/EPS)
+    struct itemsetStore *levels[STREAM_MAX_K+1];   // 元のID、頻度 f は counts
+    long long *delta[STREAM_MAX_K+1];              // 各項目の Δ (入れた時点の最大の取りこぼし)
+    long long deltaCap[STREAM_MAX_K+1];
+    int *t;             // 並べ替えたトランザクション
+    long long *up;      // その各アイテムの f + Δ (表に無ければ -1)
+    int tcap;
+};
+
+// set を1回数える。無ければ f = 1 と与えた Δ で入れる
+static void lossyAdd(struct lossyCounter *lc, int k, const int *set, long long delta) {
+    struct itemsetStore *s = lc->levels[k];
+    long long probes = 0;
+    long long p = findItemset(s, set, &probes);
+    if (p >= 0) {
+        s->counts[p]++;
+        return;
+    }
+    p = insertItemset(s, set, 1);
+    if (p >= lc->deltaCap[k]) {
+        lc->deltaCap[k] = lc->deltaCap[k] > 0 ? lc->deltaCap[k] * 2 : 1024;
+        long long *tmp = (long long*)realloc(lc->delta[k], sizeof(long long) * lc->deltaCap[k]);
+        if (!tmp) {
+            fprintf(stderr, "Error: realloc failed\n");
+            exit(1);
+        }
+        lc->delta[k] = tmp;
+    }
+    lc->delta[k][p] = delta;
+}
+// set が表にあれば f + Δ (これまでの本当の頻度の上限) を返す。無ければ -1
+static long long lossyUpper(struct lossyCounter *lc, int k, const int *set) {
+    long long probes = 0;
+    long long p = findItemset(lc->levels[k], set, &probes);
+    return p >= 0 ? lc->levels[k]->counts[p] + lc->delta[k][p] : -1;
+}
+// バケット b の終わり: f + Δ <= b の項目を捨てて表を詰め直す
+static void lossyPrune(struct lossyCounter *lc, long long b) {
+    long long entries = 0;
+    for (int k = 1; k <= STREAM_MAX_K; k++) {
+        struct itemsetStore *s = lc->levels[k];
+        entries += s->n;
+        struct itemsetStore *d = createItemsetStore(k, s->n / 2);
+        long long m = 0;
+        for (long long i = 0; i < s->n; i++) {
+            if (s->counts[i] + lc->delta[k][i] > b) {
+                insertItemset(d, &s->items[i * k], s->counts[i]);
+                lc->delta[k][m++] = lc->delta[k][i];
+            }
+        }
+        stream_pruned += s->n - m;
+        freeItemsetStore(s);
+        lc->levels[k] = d;
+    }
+    if (entries > stream_entries_peak) stream_entries_peak = entries;
+}
+// 今の表から L1..L3 (元のID、昇順) を取り出す。
+// 部分集合がすべて残っているものだけを残す (ルール抽出で部分集合を引けるように)
+static int lossyFrequent(struct lossyCounter *lc, struct itemsetStore **lv) {
+    int sub[STREAM_MAX_K];
+    long long probes = 0;
+    int maxk = 0;
+    for (int k = 1; k <= STREAM_MAX_K; k++) {
+        double minCount = (MIN_SUPPORT_RATIO - STREAM_EPSILON) * (double)lc->n - (k - 1);
+        struct itemsetStore *s = lc->levels[k];
+        struct itemsetStore *l = createItemsetStore(k, 0);
+        for (long long i = 0; i < s->n; i++) {
+            if ((double)s->counts[i] < minCount) continue;
+            const int *set = &s->items[i * k];
+            int ok = 1;
+            for (int drop = 0; drop < k && k > 1 && ok; drop++) {
+                int m = 0;
+                for (int x = 0; x < k; x++) {
+                    if (x != drop) sub[m++] = set[x];
+                }
+                if (findItemset(lv[k-1], sub, &probes) < 0) ok = 0;
+            }
+            if (ok) insertItemset(l, set, s->counts[i]);
+        }
+        sortItemsetStore(l);
+        lv[k] = l;
+        maxk = k;
+        if (l->n == 0) break;
+    }
+    return maxk;
+}
+// その時点の L1..L3 を Lk ファイルに書き出す (res があれば res にも入れる)
+static int lossySnapshot(struct lossyCounter *lc, struct mineResult *res) {
+    struct itemsetStore *lv[STREAM_MAX_K+1];
+    int maxk = lossyFrequent(lc, lv);
+    int top = publishOrigLevels(lv, maxk, lc->n, res);
+    for (int k = 1; k <= maxk; k++) freeItemsetStore(lv[k]);
+    stream_snapshots++;
+    return top;
+}
+
+// streamTransactions から1件ずつ受け取り、長さ3までの部分集合を数える。
+// 部分集合が前から表にあるかを見るので、長いほうから数える
+static void lossyTransaction(const int *items, int len, void *arg) {
+    struct lossyCounter *lc = (struct lossyCounter*)arg;
+    if (len > lc->tcap) {
+        lc->tcap = len * 2;
+        int *tmp = (int*)realloc(lc->t, sizeof(int) * lc->tcap);
+        long long *tu = (long long*)realloc(lc->up, sizeof(long long) * lc->tcap);
+        if (!tmp || !tu) {
+            fprintf(stderr, "Error: realloc failed\n");
+            exit(1);
+        }
+        lc->t = tmp;
+        lc->up = tu;
+    }
+    int *t = lc->t;
+    memcpy(t, items, sizeof(int) * len);
+    sortItems(t, len);
+    int m = 0;
+    for (int i = 0; i < len; i++) {
+        if (m == 0 || t[m-1] != t[i]) t[m++] = t[i];
+    }
+
+    lc->n++;
+    long long b = (lc->n + lc->width - 1) / lc->width;   // 今のバケット番号 (1から)
+    long long *up = lc->up;
+    for (int a = 0; a < m; a++) up[a] = lossyUpper(lc, 1, &t[a]);
+
+    // トリプル: 3つのペアがすべて表にあるもの
+    int set[STREAM_MAX_K], sub[2];
+    for (int a = 0; a < m; a++) {
+        if (up[a] < 0) continue;
+        for (int c = a + 1; c < m; c++) {
+            if (up[c] < 0) continue;
+            sub[0] = t[a];
+            sub[1] = t[c];
+            long long uac = lossyUpper(lc, 2, sub);
+            if (uac < 0) continue;
+            for (int d = c + 1; d < m; d++) {
+                if (up[d] < 0) continue;
+                sub[0] = t[a];
+                sub[1] = t[d];
+                long long uad = lossyUpper(lc, 2, sub);
+                if (uad < 0) continue;
+                sub[0] = t[c];
+                long long ucd = lossyUpper(lc, 2, sub);
+                if (ucd < 0) continue;
+                long long delta = b + 1;
+                if (uac < delta) delta = uac;
+                if (uad < delta) delta = uad;
+                if (ucd < delta) delta = ucd;
+                set[0] = t[a];
+                set[1] = t[c];
+                set[2] = t[d];
+                lossyAdd(lc, 3, set, delta);
+            }
+        }
+    }
+    // ペア: 2つのアイテムがどちらも表にあるもの
+    for (int a = 0; a < m; a++) {
+        if (up[a] < 0) continue;
+        for (int c = a + 1; c < m; c++) {
+            if (up[c] < 0) continue;
+            long long delta = b;
+            if (up[a] < delta) delta = up[a];
+            if (up[c] < delta) delta = up[c];
+            set[0] = t[a];
+            set[1] = t[c];
+            lossyAdd(lc, 2, set, delta);
+        }
+    }
+    // アイテム: 無ければ Δ = b - 1 で入れる
+    for (int a = 0; a < m; a++) {
+        lossyAdd(lc, 1, &t[a], b - 1);
+    }
+    if (lc->n % lc->width == 0) lossyPrune(lc, b);
+
+    if (STREAM_SNAPSHOT > 0 && lc->n % STREAM_SNAPSHOT == 0) {
+        lossySnapshot(lc, NULL);
+        printf("=== Snapshot at %lld transactions (entries:", lc->n);
+        for (int k = 1; k <= STREAM_MAX_K; k++) printf(" %lld", lc->levels[k]->n);
+        printf(") ===\n");
+        fflush(stdout);
+    }
+}
+
+// transaction_file ("-" なら標準入力) を1回だけ読み、最後の L1..L3 を res に入れて書き出す。
+// 戻り値は最大の k、*total_t は読んだトランザクション数
+int streamGenerateLk(const char *transaction_file, long long *total_t, struct mineResult *res) {
+    double start = nowSec();
+    struct lossyCounter lc;
+    memset(&lc, 0, sizeof(lc));
+    lc.width = (long long)(1.0 / STREAM_EPSILON);
+    if ((double)lc.width < 1.0 / STREAM_EPSILON) lc.width++;
+    for (int k = 1; k <= STREAM_MAX_K; k++) {
+        lc.levels[k] = createItemsetStore(k, 0);
+    }
+
+    FILE *fp = stdin;
+    if (strcmp(transaction_file, "-") != 0) {
+        fp = fopen(transaction_file, "rb");
+        if (!fp) {
+            fprintf(stderr, "Error: cannot open %s\n", transaction_file);
+            exit(1);
+        }
+    }
+    streamTransactions(fp, lossyTransaction, &lc);
+    if (fp != stdin) fclose(fp);
+    if (lc.n == 0) {
+        fprintf(stderr, "Error: no transactions in %s\n", transaction_file);
+        exit(1);
+    }
+
+    long long entries = 0;
+    for (int k = 1; k <= STREAM_MAX_K; k++) entries += lc.levels[k]->n;
+    if (entries > stream_entries_peak) stream_entries_peak = entries;
+    int maxk = lossySnapshot(&lc, res);
+    for (int k = 1; k <= STREAM_MAX_K; k++) {
+        freeItemsetStore(lc.levels[k]);
+        free(lc.delta[k]);
+    }
+    free(lc.t);
+    free(lc.up);
+
+    stream_time += nowSec() - start;
+    char filename[64];
+    for (int k = 1; k <= maxk; k++) {
+        levelFileName(k, filename, sizeof(filename));
+        printf("=== Stream -> %s ===\n", filename);
+        printf("Found %lld frequent %d-itemsets\n", res->levels[k]->n, k);
+    }
+    printf("Stream: %lld transactions, epsilon %.6f (bucket width %lld), peak entries %lld\n",
+           lc.n, STREAM_EPSILON, lc.width, stream_entries_peak);
+    *total_t = lc.n;
+    return maxk;
+}
 
-// ハッシュ: L1
-struct itemCountNode {
-    int item;
-    long long count;
-    struct itemCountNode *next;
-};
-static struct itemCountNode *itemCountHash[BUCKET_SIZE];
-void initItemCountHash(){
-    for(int i=0;i<BUCKET_SIZE;i++){
-        itemCountHash[i]=NULL;
-    }
-}
-int hashItemCount(int item){
-    long long key=(long long)item*31LL;
-    long long idx=key % BUCKET_SIZE;
-    if(idx<0)idx+=BUCKET_SIZE;
-    return (int)idx;
-}
-void insertItemCount(int item, long long c){
-    int h=hashItemCount(item);
-    struct itemCountNode *n=(struct itemCountNode*)malloc(sizeof(struct itemCountNode));
-    n->item=item; 
-    n->count=c;
-    n->next=itemCountHash[h];
-    itemCountHash[h]=n;
-}
-long long getItemCount(int item){
-    // → ここでは searchItemを使わない (別の構造) 
-    int h=hashItemCount(item);
-    struct itemCountNode *p=itemCountHash[h];
-    while(p){
-        if(p->item==item) return p->count;
-        p=p->next;
-    }
-    return -1;
-}
-void freeItemCountHash(){
-    for(int i=0;i<BUCKET_SIZE;i++){
-        struct itemCountNode *p=itemCountHash[i];
-        while(p){
-            struct itemCountNode *tmp=p;
-            p=p->next;
-            free(tmp);
-        }
-        itemCountHash[i]=NULL;
-    }
-}
-
-// ハッシュ: L2
-struct pairCountNode {
-    int a;
-    int b;
-    long long count;
-    struct pairCountNode *next;
-};
-static struct pairCountNode *pairCountHash[BUCKET_SIZE];
-void initPairCountHash(){
-    for(int i=0;i<BUCKET_SIZE;i++){
-        pairCountHash[i]=NULL;
-    }
-}
-int hashPairCount(int a,int b){
-    if(a>b){int t=a;a=b;b=t;}
-    long long key=(long long)a*31LL + (long long)b;
-    long long idx=key%BUCKET_SIZE;
-    if(idx<0)idx+=BUCKET_SIZE;
-    return (int)idx;
-}
-void insertPairCountVal(int a,int b,long long c){
-    if(a>b){int t=a;a=b;b=t;}
-    int h=hashPairCount(a,b);
-    struct pairCountNode *n=(struct pairCountNode*)malloc(sizeof(struct pairCountNode));
-    n->a=a; n->b=b; n->count=c;
-    n->next=pairCountHash[h];
-    pairCountHash[h]=n;
-}
-long long getPairCountVal(int a,int b){
-    int h=hashPairCount(a,b);
-    struct pairCountNode *p=pairCountHash[h];
-    while(p){
-        if(p->a==a && p->b==b) return p->count;
-        p=p->next;
-    }
-    return -1;
-}
-void freePairCountHash(){
-    for(int i=0;i<BUCKET_SIZE;i++){
-        struct pairCountNode *p=pairCountHash[i];
-        while(p){
-            struct pairCountNode *tmp=p;
-            p=p->next;
-            free(tmp);
-        }
-        pairCountHash[i]=NULL;
-    }
-}
-
-// ハッシュ: L3
-struct tripleCountNode {
-    int a;
-    int b;
-    int c;
-    long long count;
-    struct tripleCountNode *next;
+// ==================================================
+// サンプリング (--sample M, Toivonen)
+//   DBから約 M 件を無作為に選び、下げた最小支持度で (スライディングウィンドウと
+//   同じビット列の格子で) マイニングする。格子に残る C_k はサンプルでの頻出集合 S と
+//   その負の境界 NB(S) なので、全体を1回走査して S の各アイテムのビット列と
+//   全アイテムの頻度を作り、C_k をすべて正確に数える。
+//   NB(S) に本当に頻出なものが無ければ、L_k は S の中の頻出なものだけで確定する
+//   (Toivonen の定理)。あったときだけ、漏れたアイテムのビット列を2回目の走査で足し、
+//   格子を作り直して足りない候補をビット列から数える。
+//   全体のビット列が BITMAP_BUDGET に収まらないとき (と --counting htree のとき) は、
+//   S と負の境界をレベルごとのハッシュ木で1回の走査でまとめて数え、漏れがあったときだけ
+//   足りない候補をそのレベルの追加の走査で数える。
+//   結果の L1..Lk は通常の Apriori と同じになる。
+// ==================================================
+static long long SAMPLE_SIZE = 0;        // 0 ならサンプリングなし
+#define SAMPLE_SEED 0x9e3779b97f4a7c15ULL
+#define SAMPLE_MIN_COUNT 32   // サンプルでの最小支持度の頻度がこれ未満なら全件を使う
+static double sample_minsup = 0.0;       // サンプルで使った最小支持度
+static long long sample_drawn = 0;       // 実際に選んだ件数
+static long long sample_verified = 0;    // 全体で数えた候補 (S と負の境界) の数
+static long long sample_misses = 0;      // 負の境界のうち本当は頻出だったものの数
+static long long sample_fresh = 0;       // 作り直しで新たに数えた候補の数
+static int sample_scans = 0;             // DB全体の走査回数
+static int sample_htree = 0;             // 1 ならハッシュ木で確かめた (ビット列が予算を超えた)
+static double sample_time = 0.0;
+
+// サンプルの件数 m での頻度の標準偏差の2倍だけ最小支持度を下げる (元の 1/4 までに留める)
+static double loweredMinsup(double minsup, long long m) {
+    double var = minsup * (1.0 - minsup) / (double)(m > 0 ? m : 1);
+    double sd = 1.0;
+    for (int i = 0; i < 64 && var > 0.0; i++) sd = 0.5 * (sd + var / sd);   // sqrt(var) (ニュートン法)
+    if (var <= 0.0) sd = 0.0;
+    double low = minsup - 2.0 * sd;
+    return low > minsup * 0.25 ? low : minsup * 0.25;
+}
+
+// 格子の C_2..C_maxk をレベルごとのハッシュ木で、DBを1回走査して数える (c[k]->counts に足す)
+//   葉の通し番号は全部の木で重ならないように振るので、二重カウント防止の印は1本で済む。
+//   pairMatrix なら C_2 はパス2と同じ三角行列で数える (同じ走査の中で)。そのとき
+//   extend2[j] が 1 の C_2 (サンプルで頻出なペア) を2個以上含まないアイテムは、C_3 以上では使わない
+//   (格子の C_3 のペアはどれもサンプルで頻出)。
+//   数えるだけでDBは縮めない (C_k の一部しか数えないことがあるため)
+struct latticeWorker {
+    struct tranDB *db;
+    struct itemsetStore **c;
+    struct htreeNode **root;
+    int maxk;
+    long long begin, end;
+    uint32_t *matrix;                      // C_2 を三角行列で数えるときのシャード (無ければ NULL)
+    const long long *rowBase;
+    const uint64_t *extend;                // 三角行列の位置ごとに、extend2 のペアなら1
+    uint32_t *counts[MAX_ITEMSET_LEN+1];   // c[k] と同じ並びの頻度 (シャード)
+    long long *leafMark;
+    long long visits[MAX_ITEMSET_LEN+1];
+    long long checks[MAX_ITEMSET_LEN+1];
 };
-static struct tripleCountNode *tripleCountHash[BUCKET_SIZE];
-void initTripleCountHash(){
-    for(int i=0;i<BUCKET_SIZE;i++){
-        tripleCountHash[i]=NULL;
-    }
-}
-int hashTripleCount(int a,int b,int c){
-    if(a>b){int t=a;a=b;b=t;}
-    if(b>c){int t=b;b=c;c=t;}
-    if(a>b){int t=a;a=b;b=t;}
-    long long key=(long long)a*31LL+(long long)b;
-    key=key*31LL+(long long)c;
-    long long idx=key%BUCKET_SIZE;
-    if(idx<0)idx+=BUCKET_SIZE;
-    return (int)idx;
-}
-void insertTripleCountVal(int a,int b,int c,long long cnt){
-    if(a>b){int t=a;a=b;b=t;}
-    if(b>c){int t=b;b=c;c=t;}
-    if(a>b){int t=a;a=b;b=t;}
-    int h=hashTripleCount(a,b,c);
-    struct tripleCountNode *n=(struct tripleCountNode*)malloc(sizeof(struct tripleCountNode));
-    n->a=a; n->b=b; n->c=c; n->count=cnt;
-    n->next=tripleCountHash[h];
-    tripleCountHash[h]=n;
-}
-long long getTripleCountVal(int a,int b,int c){
-    if(a>b){int t=a;a=b;b=t;}
-    if(b>c){int t=b;b=c;c=t;}
-    if(a>b){int t=a;a=b;b=t;}
-    int h=hashTripleCount(a,b,c);
-    struct tripleCountNode *p=tripleCountHash[h];
-    while(p){
-        if(p->a==a && p->b==b && p->c==c) return p->count;
-        p=p->next;
-    }
-    return -1;
-}
-void freeTripleCountHash(){
-    for(int i=0;i<BUCKET_SIZE;i++){
-        struct tripleCountNode *p=tripleCountHash[i];
-        while(p){
-            struct tripleCountNode *tmp=p;
-            p=p->next;
-            free(tmp);
-        }
-        tripleCountHash[i]=NULL;
-    }
-}
-
-// L1.dat, L2.dat, L3.dat 読み込み
-void loadL1(const char *filename){
-    initItemCountHash();
-    FILE *fp=fopen(filename,"r");
-    if(!fp){
-        fprintf(stderr,"Error: cannot open %s\n",filename);
+static void* latticeThread(void *arg) {
+    struct latticeWorker *w = (struct latticeWorker*)arg;
+    struct tranDB *db = w->db;
+    struct htreeCounter hc;
+    memset(&hc, 0, sizeof(hc));
+    hc.leafMark = w->leafMark;
+    hc.hits = (int*)malloc(sizeof(int) * (db->maxlen > 0 ? db->maxlen : 1));
+    int *items = (int*)malloc(sizeof(int) * (db->maxlen > 0 ? db->maxlen : 1));
+    if (!hc.hits || !items) {
+        fprintf(stderr, "Error: malloc failed\n");
         exit(1);
     }
-    while(!feof(fp)){
-        int it;
-        long long c;
-        double sup;
-        int r=fscanf(fp,"%d %lld %lf",&it,&c,&sup);
-        if(r==3){
-            insertItemCount(it,c);
-        } else {
-            break;
+    for (long long t = w->begin; t < w->end; t++) {
+        int n = (int)(db->offsets[t+1] - db->offsets[t]);
+        memcpy(items, &db->items[db->offsets[t]], sizeof(int) * n);
+        if (w->matrix && w->maxk >= 2) {
+            memset(hc.hits, 0, sizeof(int) * n);
+            for (int i = 0; i < n; i++) {
+                long long base = w->rowBase[items[i]];
+                for (int j = i + 1; j < n; j++) {
+                    long long x = base + items[j];
+                    w->matrix[x]++;
+                    if ((w->extend[x >> 6] >> (x & 63)) & 1) {
+                        hc.hits[i]++;
+                        hc.hits[j]++;
+                    }
+                }
+            }
+            int m = 0;
+            for (int i = 0; i < n; i++) {
+                if (hc.hits[i] >= 2) items[m++] = items[i];
+            }
+            n = m;
+        }
+        for (int k = 2; k <= w->maxk && k <= n; k++) {
+            if (!w->root[k]) continue;
+            hc.c = w->c[k];
+            hc.counts = w->counts[k];
+            hc.visits = hc.checks = 0;
+            memset(hc.hits, 0, sizeof(int) * n);
+            countHtree(w->root[k], &hc, items, n, 0, t);
+            w->visits[k] += hc.visits;
+            w->checks[k] += hc.checks;
+            // 格子の C_{k+1} の k部分集合はすべて C_k にあるので、含まれる候補が
+            // k 個未満のアイテムは次のレベルでは使わない (パスkの刈り込みと同じ)
+            if (k < w->maxk && w->root[k+1]) {
+                int m = 0;
+                for (int i = 0; i < n; i++) {
+                    if (hc.hits[i] >= k) items[m++] = items[i];
+                }
+                n = m;
+            }
         }
     }
-    fclose(fp);
+    free(items);
+    free(hc.hits);
+    return NULL;
 }
-void loadL2(const char *filename){
-    initPairCountHash();
-    FILE *fp=fopen(filename,"r");
-    if(!fp){
-        fprintf(stderr,"Error: cannot open %s\n", filename);
+static void countLatticeHtree(struct tranDB *db, struct itemsetStore **c, int maxk, int pairMatrix,
+                              const char *extend2) {
+    struct htreeNode *root[MAX_ITEMSET_LEN+1];
+    memset(root, 0, sizeof(root));
+    long long n = numDenseItems;
+    long long cells = n * (n - 1) / 2;
+    long long *rowBase = NULL;
+    if (pairMatrix && maxk >= 2 && c[2] && c[2]->n > 0) {
+        rowBase = (long long*)malloc(sizeof(long long) * (n > 0 ? n : 1));
+        if (!rowBase) {
+            fprintf(stderr, "Error: malloc failed\n");
+            exit(1);
+        }
+        for (long long i = 0; i < n; i++) rowBase[i] = i * (2 * n - i - 1) / 2 - i - 1;
+    }
+    uint64_t *extend = NULL;
+    if (rowBase) {
+        extend = (uint64_t*)calloc((cells + 63) / 64 + 1, sizeof(uint64_t));
+        if (!extend) {
+            fprintf(stderr, "Error: malloc failed\n");
+            exit(1);
+        }
+        for (long long j = 0; j < c[2]->n; j++) {
+            if (!extend2[j]) continue;
+            long long x = rowBase[c[2]->items[j * 2]] + c[2]->items[j * 2 + 1];
+            extend[x >> 6] |= 1ULL << (x & 63);
+        }
+    }
+    htree_fanout = HTREE_FANOUT_MIN;
+    while (htree_fanout < numDenseItems && htree_fanout < HTREE_FANOUT_MAX) {
+        htree_fanout *= 2;
+    }
+    if (!htree_arena) htree_arena = createArena(ARENA_BLOCK_SIZE);
+    htree_nleaves = 0;
+    for (int k = 2; k <= maxk; k++) {
+        if (!c[k] || c[k]->n == 0 || (k == 2 && rowBase)) continue;
+        root[k] = createHtreeNode(0);
+        for (long long i = 0; i < c[k]->n; i++) insertHtree(root[k], c[k], i);
+        numberHtreeLeaves(root[k]);
+    }
+
+    struct latticeWorker *w = (struct latticeWorker*)calloc(NUM_THREADS, sizeof(struct latticeWorker));
+    long long *bounds = (long long*)malloc(sizeof(long long) * (NUM_THREADS + 1));
+    if (!w || !bounds) {
+        fprintf(stderr, "Error: malloc failed\n");
         exit(1);
     }
-    while(!feof(fp)){
-        int a,b;
-        long long c;
-        double sup;
-        int r=fscanf(fp,"%d %d %lld %lf",&a,&b,&c,&sup);
-        if(r==4){
-            insertPairCountVal(a,b,c);
-        } else {
+    splitByCost(db, 2, NUM_THREADS, bounds);
+    for (int i = 0; i < NUM_THREADS; i++) {
+        w[i].db = db;
+        w[i].c = c;
+        w[i].root = root;
+        w[i].maxk = maxk;
+        w[i].begin = bounds[i];
+        w[i].end = bounds[i+1];
+        w[i].leafMark = (long long*)malloc(sizeof(long long) * (htree_nleaves > 0 ? htree_nleaves : 1));
+        if (!w[i].leafMark) {
+            fprintf(stderr, "Error: malloc failed\n");
+            exit(1);
+        }
+        for (long long j = 0; j < htree_nleaves; j++) w[i].leafMark[j] = -1;
+        if (rowBase) {
+            w[i].rowBase = rowBase;
+            w[i].extend = extend;
+            w[i].matrix = (uint32_t*)calloc(cells > 0 ? cells : 1, sizeof(uint32_t));
+            if (!w[i].matrix) {
+                fprintf(stderr, "Error: malloc failed for pair matrix\n");
+                exit(1);
+            }
+        }
+        for (int k = 2; k <= maxk; k++) {
+            if (!root[k]) continue;
+            w[i].counts[k] = (uint32_t*)calloc(c[k]->n, sizeof(uint32_t));
+            if (!w[i].counts[k]) {
+                fprintf(stderr, "Error: malloc failed\n");
+                exit(1);
+            }
+        }
+    }
+    runWorkers(latticeThread, w, sizeof(struct latticeWorker), NUM_THREADS);
+    for (int i = 0; i < NUM_THREADS; i++) {
+        for (int k = 2; k <= maxk; k++) {
+            if (!root[k]) continue;
+            for (long long j = 0; j < c[k]->n; j++) c[k]->counts[j] += w[i].counts[k][j];
+            htree_visits[k] += w[i].visits[k];
+            htree_checks[k] += w[i].checks[k];
+            free(w[i].counts[k]);
+        }
+        free(w[i].leafMark);
+        if (i > 0 && rowBase) {
+            for (long long x = 0; x < cells; x++) w[0].matrix[x] += w[i].matrix[x];
+            free(w[i].matrix);
+        }
+    }
+    if (rowBase) {
+        for (long long j = 0; j < c[2]->n; j++) {
+            const int *set = &c[2]->items[j * 2];
+            c[2]->counts[j] += w[0].matrix[rowBase[set[0]] + set[1]];
+        }
+        free(w[0].matrix);
+        free(rowBase);
+        free(extend);
+    }
+    free(w);
+    free(bounds);
+    for (int k = 2; k <= maxk; k++) {
+        if (root[k]) {
+            freeHtree(root[k]);   // アリーナごと返すので1回で全部の木が消える
             break;
         }
     }
-    fclose(fp);
 }
-void loadL3(const char *filename){
-    initTripleCountHash();
+
+// 全体のビット列が予算を超えるときの確かめ方 (itemHash に全アイテムの頻度が入っていること)
+//   全体の頻出アイテムで密なIDに直し、S と負の境界の C_2..C_maxk をまとめて1回の走査で数える
+//   (頻出でないアイテムを含む格子の候補は数えなくても頻出でない)。
+//   そのあと L_{k-1} から C_k を作り、格子で数えた頻度を使う。NB(S) に漏れがなければ
+//   C_k は格子の中に収まるので追加の走査は要らない。漏れがあったときだけ、
+//   格子に無い候補をそのレベルだけ走査して数える
+static int sampleVerifyHtree(struct tranDB *db, struct slidingWindow *smp, long long N,
+                             double minsup, struct mineResult *res) {
+    struct remapEntry *freq = (struct remapEntry*)malloc(sizeof(struct remapEntry) * (itemHash.n > 0 ? itemHash.n : 1));
+    if (!freq) {
+        fprintf(stderr, "Error: malloc failed\n");
+        exit(1);
+    }
+    long long probes = 0;
+    int nfreq = 0;
+    for (long long h = 0; h < itemHash.n; h++) {
+        if (!isFrequentCount(itemHash.counts[h], N, minsup)) continue;
+        long long p = findItemset(smp->levels[1], &itemHash.items[h], &probes);
+        if (p < 0 || !smp->freq[1][p]) sample_misses++;
+        freq[nfreq].item = itemHash.items[h];
+        freq[nfreq].count = itemHash.counts[h];
+        nfreq++;
+    }
+    sample_verified += itemHash.n;
+    freeItemHash();
+    struct itemsetStore *l1 = remapItems(db, freq, nfreq);
+    free(freq);
+    trimTransactions(db, l1, NULL);
+    writeLevelFile(l1, N);
+    res->levels[1] = l1;
+
+    // 格子の候補を密なIDに直す (元のID → 密なIDは dense の添字で引く)
+    struct itemsetStore *dense = createItemsetStore(1, l1->n);
+    for (long long i = 0; i < l1->n; i++) insertItemset(dense, &origItemId[i], 0);
+    struct itemsetStore *lat[MAX_ITEMSET_LEN+1];
+    memset(lat, 0, sizeof(lat));
+    char *extend2 = (char*)malloc(smp->maxk >= 2 && smp->levels[2]->n > 0 ? smp->levels[2]->n : 1);
+    if (!extend2) {
+        fprintf(stderr, "Error: malloc failed\n");
+        exit(1);
+    }
+    int set[MAX_ITEMSET_LEN];
+    for (int k = 2; k <= smp->maxk; k++) {
+        struct itemsetStore *s = smp->levels[k];
+        lat[k] = createItemsetStore(k, s->n);
+        for (long long i = 0; i < s->n; i++) {
+            int ok = 1;
+            for (int j = 0; j < k && ok; j++) {
+                long long d = findItemset(dense, &s->items[i * k + j], &probes);
+                if (d < 0) ok = 0;
+                else set[j] = (int)d;
+            }
+            if (!ok) continue;
+            sortItems(set, k);
+            if (k == 2) extend2[lat[k]->n] = smp->freq[2][i];
+            insertItemset(lat[k], set, 0);
+        }
+        sample_verified += s->n;
+    }
+    freeItemsetStore(dense);
+    countLatticeHtree(db, lat, smp->maxk, COUNTING_MODE != COUNT_BITMAP && pairMatrixFits(l1->n), extend2);
+    free(extend2);
+    sample_scans++;
+
+    // 負の境界の確認 (格子の中で、サンプルでは頻出でなかったのに全体では頻出なもの)
+    int orig[MAX_ITEMSET_LEN];
+    for (int k = 2; k <= smp->maxk; k++) {
+        for (long long i = 0; i < lat[k]->n; i++) {
+            if (!isFrequentCount(lat[k]->counts[i], N, minsup)) continue;
+            toOrigItems(&lat[k]->items[i * k], k, orig);
+            long long p = findItemset(smp->levels[k], orig, &probes);
+            if (p < 0 || !smp->freq[k][p]) sample_misses++;
+        }
+    }
+
+    struct itemsetStore *prev = l1;
+    int maxk = 1;
+    for (int k = 2; k <= MAX_ITEMSET_LEN; k++) {
+        if (prev->n == 0 && k > 3) break;
+        struct itemsetStore *c = generateCandidates(prev);
+        struct itemsetStore *fresh[MAX_ITEMSET_LEN+1];
+        memset(fresh, 0, sizeof(fresh));
+        fresh[k] = createItemsetStore(k, 0);
+        long long *fpos = (long long*)malloc(sizeof(long long) * (c->n > 0 ? c->n : 1));
+        if (!fpos) {
+            fprintf(stderr, "Error: malloc failed\n");
+            exit(1);
+        }
+        for (long long i = 0; i < c->n; i++) {
+            long long p = lat[k] ? findItemset(lat[k], &c->items[i * k], &probes) : -1;
+            if (p >= 0) {
+                c->counts[i] = lat[k]->counts[p];
+            } else {
+                fpos[fresh[k]->n] = i;
+                insertItemset(fresh[k], &c->items[i * k], 0);
+            }
+        }
+        if (fresh[k]->n > 0) {
+            countLatticeHtree(db, fresh, k, 0, NULL);
+            for (long long j = 0; j < fresh[k]->n; j++) c->counts[fpos[j]] = fresh[k]->counts[j];
+            sample_fresh += fresh[k]->n;
+            sample_scans++;
+        }
+        free(fpos);
+        freeItemsetStore(fresh[k]);
+        struct itemsetStore *l = extractFrequent(c, N);
+        freeItemsetStore(c);
+        writeLevelFile(l, N);
+        res->levels[k] = l;
+        res->maxk = k;
+        prev = l;
+        maxk = k;
+    }
+    for (int k = 2; k <= smp->maxk; k++) freeItemsetStore(lat[k]);
+    return maxk;
+}
+
+// db (元のID) から L1..Lk を求めて res に入れて書き出す。戻り値は最大の k
+int sampleGenerateLk(struct tranDB *db, long long *total_t, struct mineResult *res) {
+    double start = nowSec();
+    initPopcount();
+    long long N = db->n;
+    if (N == 0) {
+        fprintf(stderr, "Error: no transactions\n");
+        exit(1);
+    }
+
+    // A) 各トランザクションを確率 M/N で選ぶ (xorshift、種は固定なので結果は決定的)
+    long long *pick = (long long*)malloc(sizeof(long long) * N);
+    if (!pick) {
+        fprintf(stderr, "Error: malloc failed\n");
+        exit(1);
+    }
+    //    小さすぎるサンプルは1件の偶然で長いアイテムセットまで頻出になり、格子が爆発する
+    uint64_t rng = SAMPLE_SEED;
+    double minsup = MIN_SUPPORT_RATIO;
+    double rate = SAMPLE_SIZE < N ? (double)SAMPLE_SIZE / (double)N : 1.0;
+    if ((double)SAMPLE_SIZE * minsup < SAMPLE_MIN_COUNT && rate < 1.0) {
+        fprintf(stderr, "Warning: --sample %lld expects fewer than %d occurrences at minsup %.4f; "
+                "using all %lld transactions\n", SAMPLE_SIZE, SAMPLE_MIN_COUNT, minsup, N);
+        rate = 1.0;
+    }
+    long long m = 0;
+    for (long long t = 0; t < N; t++) {
+        rng ^= rng << 13;
+        rng ^= rng >> 7;
+        rng ^= rng << 17;
+        if ((double)(rng >> 11) * (1.0 / 9007199254740992.0) < rate) pick[m++] = t;
+    }
+    if (m == 0) pick[m++] = 0;
+    sample_drawn = m;
+
+    // B) サンプルをビット列に入れ、下げた最小支持度で格子 (S と負の境界) を作る
+    struct slidingWindow smp;
+    memset(&smp, 0, sizeof(smp));
+    smp.N = m;
+    smp.W = (m + 63) / 64;
+    smp.levels[1] = createItemsetStore(1, ITEM_PRESIZE);
+    smp.maxk = 1;
+    for (long long j = 0; j < m; j++) {
+        long long t = pick[j];
+        for (long long i = db->offsets[t]; i < db->offsets[t+1]; i++) {
+            long long r = windowItemRow(&smp, db->items[i]);
+            windowBits(&smp, r)[j >> 6] |= 1ULL << (j & 63);
+            smp.levels[1]->counts[r]++;
+        }
+    }
+    free(pick);
+    sample_minsup = m < N ? loweredMinsup(minsup, m) : minsup;
+    windowRebuild(&smp, m, sample_minsup, 0);
+
+    // C) 1回目の走査: 全アイテムの頻度と、S のアイテムの全体でのビット列を作る
+    //    (ビット列が予算に収まるときだけ。収まらなければ頻度だけ数えてハッシュ木で確かめる)
+    long long W = (N + 63) / 64;
+    long long rowsS = 0;
+    for (long long r = 0; r < smp.levels[1]->n; r++) rowsS += smp.freq[1][r];
+    int useBits = COUNTING_MODE != COUNT_HTREE && rowsS * W * (long long)sizeof(uint64_t) <= BITMAP_BUDGET;
+    struct slidingWindow full;
+    memset(&full, 0, sizeof(full));
+    full.N = N;
+    full.W = W;
+    full.levels[1] = createItemsetStore(1, smp.levels[1]->n);
+    full.maxk = 1;
+    initItemHash(ITEM_PRESIZE);
+    long long probes = 0;
+    for (long long t = 0; t < N; t++) {
+        for (long long i = db->offsets[t]; i < db->offsets[t+1]; i++) {
+            int item = db->items[i];
+            insertOrUpdateItem(item);
+            if (!useBits) continue;
+            long long p = findItemset(smp.levels[1], &item, &probes);
+            if (p < 0 || !smp.freq[1][p]) continue;
+            long long r = windowItemRow(&full, item);
+            windowBits(&full, r)[t >> 6] |= 1ULL << (t & 63);
+        }
+    }
+    sample_scans++;
+    for (long long r = 0; r < full.levels[1]->n; r++) {
+        full.levels[1]->counts[r] = itemHash.counts[searchItem(full.levels[1]->items[r])];
+    }
+    // S と負の境界の C_k (k >= 2) を全体のビット列で数える
+    for (int k = 2; useBits && k <= smp.maxk; k++) {
+        struct itemsetStore *c = createItemsetStore(k, smp.levels[k]->n);
+        for (long long i = 0; i < smp.levels[k]->n; i++) {
+            insertItemset(c, &smp.levels[k]->items[i * k], 0);
+        }
+        windowCountStore(&full, c, 0, N, 1, NULL);
+        full.levels[k] = c;
+        full.freq[k] = (char*)calloc(c->n > 0 ? c->n : 1, 1);
+        if (!full.freq[k]) {
+            fprintf(stderr, "Error: malloc failed\n");
+            exit(1);
+        }
+        full.maxk = k;
+        sample_verified += c->n;
+    }
+
+    // D) 負の境界の確認: サンプルで頻出でなかったのに全体では頻出なもの
+    long long missedItems = 0;
+    for (long long h = 0; useBits && h < itemHash.n; h++) {
+        if (!isFrequentCount(itemHash.counts[h], N, minsup)) continue;
+        long long p = findItemset(smp.levels[1], &itemHash.items[h], &probes);
+        if (p < 0 || !smp.freq[1][p]) missedItems++;
+    }
+    sample_verified += itemHash.n;
+    sample_misses = missedItems;
+    for (int k = 2; k <= full.maxk; k++) {
+        for (long long i = 0; i < full.levels[k]->n; i++) {
+            if (isFrequentCount(full.levels[k]->counts[i], N, minsup) && !smp.freq[k][i]) sample_misses++;
+        }
+    }
+
+    //    漏れたアイテムのビット列まで足すと予算を超えるなら、ハッシュ木で確かめ直す
+    if (useBits && (rowsS + missedItems) * W * (long long)sizeof(uint64_t) > BITMAP_BUDGET) {
+        useBits = 0;
+        sample_verified = 0;
+        sample_misses = 0;
+    }
+    int maxk;
+    if (!useBits) {
+        freeSlidingWindow(&full);
+        sample_htree = 1;
+        maxk = sampleVerifyHtree(db, &smp, N, minsup, res);
+        freeSlidingWindow(&smp);
+    } else {
+        // E) 2回目の走査 (漏れたアイテムがあるときだけ): そのビット列を足す。
+        //    格子の作り直しで、数えていない候補は全体のビット列から数える
+        if (missedItems > 0) {
+            for (long long t = 0; t < N; t++) {
+                for (long long i = db->offsets[t]; i < db->offsets[t+1]; i++) {
+                    int item = db->items[i];
+                    long long h = searchItem(item);
+                    if (!isFrequentCount(itemHash.counts[h], N, minsup)) continue;
+                    long long r = findItemset(full.levels[1], &item, &probes);
+                    if (r < 0) {
+                        r = windowItemRow(&full, item);
+                        full.levels[1]->counts[r] = itemHash.counts[h];
+                    }
+                    windowBits(&full, r)[t >> 6] |= 1ULL << (t & 63);
+                }
+            }
+            sample_scans++;
+        }
+        freeItemHash();
+        freeSlidingWindow(&smp);
+        long long fresh = window_fresh;
+        windowRebuild(&full, N, minsup, 0);
+        sample_fresh = window_fresh - fresh;
+
+        struct itemsetStore *lv[MAX_ITEMSET_LEN+1];
+        for (int k = 1; k <= full.maxk; k++) lv[k] = windowFrequent(&full, k);
+        maxk = publishOrigLevels(lv, full.maxk, N, res);
+        for (int k = 1; k <= full.maxk; k++) freeItemsetStore(lv[k]);
+        freeSlidingWindow(&full);
+    }
+
+    sample_time += nowSec() - start;
+    char filename[64];
+    for (int k = 1; k <= maxk; k++) {
+        levelFileName(k, filename, sizeof(filename));
+        printf("=== Sample -> %s ===\n", filename);
+        printf("Found %lld frequent %d-itemsets\n", res->levels[k]->n, k);
+    }
+    printf("Sample: %lld of %lld transactions at minsup %.6f, %lld candidates verified, "
+           "%lld border misses (%lld counted afterwards), %d full scans\n",
+           sample_drawn, N, sample_minsup, sample_verified, sample_misses, sample_fresh, sample_scans);
+    if (sample_htree && COUNTING_MODE == COUNT_HTREE) {
+        printf("Sample: verified with one hash tree per level (--counting htree)\n");
+    } else if (sample_htree) {
+        printf("Sample: full-DB bitmaps exceed %lld MB, verified with one hash tree per level\n",
+               BITMAP_BUDGET / (1024 * 1024));
+    }
+    *total_t = N;
+    return maxk;
+}
+
+// --------------------------------------------------
+// 相関ルール抽出
+// --------------------------------------------------
+
+// 表: L1..Lk
+//   どれも itemsetStore (開番地法、キーは uint64_t に詰める) に入れる。
+//   ルール抽出の探索はパスkの探索回数には数えない。
+//   --rules-from memory (既定) ではマイニングで作った L1..Lk (密なID) を
+//   そのまま借りて引く。--rules-from files では Lk ファイルを読み直す (元のID)。
+#define RULES_FROM_MEMORY 0
+#define RULES_FROM_FILES  1
+static int RULES_SOURCE = RULES_FROM_MEMORY;
+
+static struct itemsetStore *ruleLevels[MAX_ITEMSET_LEN+1];
+static int ruleMaxK = 0;
+static int ruleDenseIds = 0;             // 1 なら ruleLevels は密なID (マイニング結果を借りている)
+static long long ruleLookupProbes = 0;   // ルール抽出で見たスロット数
+
+// マイニング結果 L1..Lmaxk をそのままルール抽出の表にする (コピーも読み直しもしない)
+void useMinedLevels(struct mineResult *res, int maxk){
+    for(int k=1;k<=maxk;k++){
+        ruleLevels[k]=res->levels[k];
+    }
+    ruleMaxK=maxk;
+    ruleDenseIds=1;
+}
+void freeRuleLevels(){
+    for(int k=1;k<=ruleMaxK;k++){
+        if(!ruleDenseIds) freeItemsetStore(ruleLevels[k]);   // 借りた表はマイニング側で解放する
+        ruleLevels[k]=NULL;
+    }
+    ruleMaxK=0;
+}
+// 表のIDを出力用の元のIDに直す
+static inline int ruleItem(int id){
+    return ruleDenseIds ? origItemId[id] : id;
+}
+// set[0..k) を表のIDの昇順に並べて L_k から頻度を引く。無ければ -1
+//   表は読むだけなので、ルール抽出のスレッドから同時に呼んでよい
+long long getRuleCount(const int *set, int k, long long *probes){
+    int key[MAX_ITEMSET_LEN];
+    memcpy(key,set,sizeof(int)*k);
+    sortItems(key,k);
+    long long p=findItemset(ruleLevels[k],key,probes);
+    return p>=0 ? ruleLevels[k]->counts[p] : -1;
+}
+// 表の i 番目のセットを取り出し、元のIDの昇順に並べる (ルールの表示順を読み込み方によらずそろえる)
+static void ruleItems(struct itemsetStore *s, long long i, int *out){
+    int k=s->k;
+    memcpy(out,&s->items[i*k],sizeof(int)*k);
+    for(int x=1;x<k;x++){
+        int v=out[x], y=x;
+        while(y>0 && ruleItem(out[y-1])>ruleItem(v)){ out[y]=out[y-1]; y--; }
+        out[y]=v;
+    }
+}
+
+// Lk.bin を mmap して itemsetStore に入れる (文字列の解析は要らない)
+struct itemsetStore* loadItemsetBinary(const char *filename, int k){
+
+    struct mappedFile mf;
+    mapFile(filename, &mf);
+    struct lfileHeader h;
+    if(mf.len < sizeof(h)){
+        fprintf(stderr,"Error: %s is not a binary L-file\n",filename);
+        exit(1);
+    }
+    memcpy(&h, mf.buf, sizeof(h));
+    if(memcmp(h.magic, LFILE_MAGIC, sizeof(h.magic))!=0 || h.k!=k || h.n<0 ||
+       mf.len < lfileCountsOffset(h.n,k) + sizeof(int64_t)*(size_t)h.n){
+        fprintf(stderr,"Error: %s is not a binary L%d-file\n",filename,k);
+        exit(1);
+    }
+    const int32_t *items=(const int32_t*)(mf.buf + sizeof(h));
+    const int64_t *counts=(const int64_t*)(mf.buf + lfileCountsOffset(h.n,k));
+    struct itemsetStore *s=createItemsetStore(k,h.n);
+    for(long long i=0;i<h.n;i++){
+        insertItemset(s,&items[i*k],counts[i]);
+    }
+    unmapFile(&mf);
+    return s;
+}
+
+// Lk.dat ("item1 ... itemk count support") / Lk.bin を読み込む (--rules-from files のとき)
+void loadLevel(const char *filename, int k){
+    if(LFILE_FORMAT==LFORMAT_BINARY){
+        ruleLevels[k]=loadItemsetBinary(filename,k);
+        return;
+    }
+    ruleLevels[k]=createItemsetStore(k,0);
     FILE *fp=fopen(filename,"r");
     if(!fp){
         fprintf(stderr,"Error: cannot open %s\n",filename);
         exit(1);
     }
+    int set[MAX_ITEMSET_LEN];
     while(!feof(fp)){
-        int a,b,c;
-        long long cnt;
+        int r=0;
+        for(int j=0;j<k;j++){
+            r+=fscanf(fp,"%d",&set[j]);
+        }
+        long long c;
         double sup;
-        int r=fscanf(fp,"%d %d %d %lld %lf",&a,&b,&c,&cnt,&sup);
-        if(r==5){
-            insertTripleCountVal(a,b,c,cnt);
+        r+=fscanf(fp,"%lld %lf",&c,&sup);
+        if(r==k+2){
+            sortItems(set,k);
+            insertItemset(ruleLevels[k],set,c);
         } else {
             break;
         }
     }
     fclose(fp);
 }
+void loadLevels(int maxk){
+    char filename[64];
+    for(int k=1;k<=maxk;k++){
+        levelFileName(k,filename,sizeof(filename));
+        loadLevel(filename,k);
+    }
+    ruleMaxK=maxk;
+    ruleDenseIds=0;
+}
 
-// ルール抽出
-void rulesFromL2() {
-    for(int i=0;i<BUCKET_SIZE;i++){
-        struct pairCountNode *p=pairCountHash[i];
-        while(p){
-            int a=p->a;
-            int b=p->b;
-            long long pair_cnt=p->count; 
-            // {a} => {b}
-            long long a_cnt = getItemCount(a);
-            if(a_cnt>0){
-                double conf=(double)pair_cnt/(double)a_cnt;
-                if(conf>=MIN_CONFIDENCE){
-                    double sup=(double)pair_cnt/(double)TOTAL_TRANSACTIONS;
-                    printf("{%d} => {%d}, support=%.4f, confidence=%.4f\n",a,b,sup,conf);
-                    generated_rules++;
-                }
-            }
-            // {b} => {a}
-            long long b_cnt = getItemCount(b);
-            if(b_cnt>0){
-                double conf=(double)pair_cnt/(double)b_cnt;
-                if(conf>=MIN_CONFIDENCE){
-                    double sup=(double)pair_cnt/(double)TOTAL_TRANSACTIONS;
-                    printf("{%d} => {%d}, support=%.4f, confidence=%.4f\n",b,a,sup,conf);
-                    generated_rules++;
-                }
-            }
-            p=p->next;
-        }
-    }
-}
-void rulesFromL3() {
-    for(int i=0;i<BUCKET_SIZE;i++){
-        struct tripleCountNode *p=tripleCountHash[i];
-        while(p){
-            int a=p->a;
-            int b=p->b;
-            int c=p->c;
-            long long triple_cnt=p->count;
-
-            // {a} => {b,c}
-            long long a_cnt=getItemCount(a);
-            if(a_cnt>0 && triple_cnt>0){
-                double conf=(double)triple_cnt/(double)a_cnt;
-                if(conf>=MIN_CONFIDENCE){
-                    double sup=(double)triple_cnt/(double)TOTAL_TRANSACTIONS;
-                    printf("{%d} => {%d, %d}, support=%.4f, confidence=%.4f\n",
-                        a,b,c, sup, conf);
-                    generated_rules++;
-                }
-            }
-            // {b} => {a,c}
-            long long b_cnt=getItemCount(b);
-            if(b_cnt>0 && triple_cnt>0){
-                double conf=(double)triple_cnt/(double)b_cnt;
-                if(conf>=MIN_CONFIDENCE){
-                    double sup=(double)triple_cnt/(double)TOTAL_TRANSACTIONS;
-                    printf("{%d} => {%d, %d}, support=%.4f, confidence=%.4f\n",
-                        b,a,c, sup, conf);
-                    generated_rules++;
-                }
-            }
-            // {c} => {a,b}
-            long long c_cnt=getItemCount(c);
-            if(c_cnt>0 && triple_cnt>0){
-                double conf=(double)triple_cnt/(double)c_cnt;
-                if(conf>=MIN_CONFIDENCE){
-                    double sup=(double)triple_cnt/(double)TOTAL_TRANSACTIONS;
-                    printf("{%d} => {%d, %d}, support=%.4f, confidence=%.4f\n",
-                        c,a,b, sup, conf);
-                    generated_rules++;
-                }
+// --------------------------------------------------
+// 上位K件のルール (--top-k K --rank confidence|lift|support)
+//   全部を出力せず、スコアの上位K件だけをスレッドごとの最小ヒープに残し、
+//   最後にまとめて並べ替えて出す。同点なら (k, Lk での位置, 結論部) の順で前のものを残す。
+//   ヒープがいっぱいになったら、その最小値に届かない結論部は大きくしない
+//   (結論部を大きくすると confidence も、lift の上限 confidence/sup(f) も下がる)。
+// --------------------------------------------------
+#define RANK_CONFIDENCE 0
+#define RANK_LIFT       1
+#define RANK_SUPPORT    2
+static long long TOP_K = 0;           // 0 なら全部出力する
+static int RULE_RANK = RANK_CONFIDENCE;
+static const char *rankName[] = {"confidence", "lift", "support"};
+
+struct topRule {
+    double score;
+    double conf, lift;
+    long long cnt;
+    long long idx;      // L_k の中の位置
+    uint64_t h;         // 結論部
+    int k;
+};
+// a が b より下位なら 1
+static int topRuleWorse(const struct topRule *a, const struct topRule *b){
+    if(a->score!=b->score) return a->score<b->score;
+    if(a->k!=b->k) return a->k>b->k;
+    if(a->idx!=b->idx) return a->idx>b->idx;
+    return a->h>b->h;
+}
+static int compareTopRule(const void *a, const void *b){
+    const struct topRule *x=(const struct topRule*)a, *y=(const struct topRule*)b;
+    return topRuleWorse(x,y) - topRuleWorse(y,x);
+}
+// heap[0..n) は最下位が根の最小ヒープ。上位K件に入るなら入れる
+static void topRuleOffer(struct topRule *heap, long long *n, const struct topRule *r){
+    long long i;
+    if(*n<TOP_K){
+        i=(*n)++;
+        while(i>0 && topRuleWorse(r,&heap[(i-1)/2])){
+            heap[i]=heap[(i-1)/2];
+            i=(i-1)/2;
+        }
+        heap[i]=*r;
+        return;
+    }
+    if(!topRuleWorse(&heap[0],r)) return;
+    i=0;
+    for(;;){
+        long long c=2*i+1;
+        if(c>=*n) break;
+        if(c+1<*n && topRuleWorse(&heap[c+1],&heap[c])) c++;
+        if(!topRuleWorse(&heap[c],r)) break;
+        heap[i]=heap[c];
+        i=c;
+    }
+    heap[i]=*r;
+}
+// ヒープに入り得る最低のスコア (いっぱいでなければ -1)
+static inline double topRuleFloor(const struct topRule *heap, long long n){
+    return n<TOP_K ? -1.0 : heap[0].score;
+}
+
+// ルール抽出 (ap-genrules)
+//   頻出アイテムセット f ごとに、結論部 Y を1個から1つずつ大きくしていく。
+//   確信度 sup(f)/sup(f-Y) は Y を大きくすると下がる (前提部の頻度が増える) ので、
+//   X→Y が minconf を満たさなければ Y を含むもっと大きな結論部も調べない。
+//   結論部は f の中の位置のビット集合で持つ (k <= 64)。
+//
+//   L2..Lk を1列に並べて、試すルール数の見込みがそろうように --threads 個の
+//   区間に分ける。各スレッドは自分の区間のルールを自分のバッファに整形し、
+//   --rule-order ordered (既定) なら最後にスレッド順につなげて出す (1スレッドと同じ順)。
+//   --rule-order any ならバッファがいっぱいになるたびに出す (順番は実行ごとに変わる)。
+#define RULE_ORDER_ORDERED 0
+#define RULE_ORDER_ANY     1
+static int RULE_ORDER = RULE_ORDER_ORDERED;
+static FILE *ruleOut = NULL;      // ルールの出力先 (既定は stdout, --rules-out FILE)
+static pthread_mutex_t ruleOutLock = PTHREAD_MUTEX_INITIALIZER;
+
+struct ruleWork {
+    uint64_t *cur;      // 大きさ m の結論部のうち minconf を満たしたもの (昇順)
+    uint64_t *next;     // 大きさ m+1 の候補
+    long long cap;
+    struct outBuf out;  // 整形済みのルール
+    int id;             // スレッド番号 (0 が先頭の区間)
+    int flushable;      // 1 ならバッファがたまったら途中で書き出してよい
+    long long begin, end;   // L2..Lk を並べた通し番号の区間 [begin, end)
+    long long rules;    // 出力したルール数
+    long long probes;   // 表で見たスロット数
+    long long idx;      // いま見ているセットの L_k の中の位置
+    struct topRule *top;    // --top-k のときの上位K件 (最小ヒープ)
+    long long ntop;
+};
+static int compareMask(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t*)a, y = *(const uint64_t*)b;
+    return (x > y) - (x < y);
+}
+static void growRuleWork(struct ruleWork *w, long long need){
+    if(need<=w->cap) return;
+    long long cap=w->cap>0 ? w->cap : 64;
+    while(cap<need) cap*=2;
+    uint64_t *tc=(uint64_t*)realloc(w->cur,sizeof(uint64_t)*cap);
+    uint64_t *tn=(uint64_t*)realloc(w->next,sizeof(uint64_t)*cap);
+    if(!tc || !tn){
+        fprintf(stderr,"Error: realloc failed\n");
+        exit(1);
+    }
+    w->cur=tc;
+    w->next=tn;
+    w->cap=cap;
+}
+// set の中で mask のビットが立っている (立っていない) 位置のアイテムを {..} で書く
+static void appendRuleSide(struct ruleWork *w, const int *set, int k, uint64_t mask, int want){
+    int first=1;
+    outChar(&w->out,'{');
+    for(int j=0;j<k;j++){
+        if((int)((mask>>j)&1)!=want) continue;
+        if(!first) outStr(&w->out,", ");
+        outInt(&w->out,ruleItem(set[j]));
+        first=0;
+    }
+    outChar(&w->out,'}');
+}
+// 結論部 h を試し、minconf を満たせばバッファに書いて 1 を返す
+static int tryRule(struct ruleWork *w, const int *set, int k, long long cnt, uint64_t h){
+    int ante[MAX_ITEMSET_LEN];
+    int na=0;
+    for(int j=0;j<k;j++){
+        if(!((h>>j)&1)) ante[na++]=set[j];
+    }
+    long long ante_cnt=getRuleCount(ante,na,&w->probes);
+    if(ante_cnt<=0 || cnt<=0) return 0;
+    double conf=(double)cnt/(double)ante_cnt;
+    if(conf<MIN_CONFIDENCE) return 0;
+    double sup=(double)cnt/(double)TOTAL_TRANSACTIONS;
+    if(TOP_K>0){
+        struct topRule r;
+        r.conf=conf;
+        r.lift=0.0;
+        r.cnt=cnt;
+        r.idx=w->idx;
+        r.h=h;
+        r.k=k;
+        double bound;
+        if(RULE_RANK==RANK_LIFT){
+            int cons[MAX_ITEMSET_LEN];
+            int nc=0;
+            for(int j=0;j<k;j++){
+                if((h>>j)&1) cons[nc++]=set[j];
             }
-            // {a,b} => {c}
-            long long ab_cnt=getPairCountVal(a,b);
-            if(ab_cnt>0 && triple_cnt>0){
-                double conf=(double)triple_cnt/(double)ab_cnt;
-                if(conf>=MIN_CONFIDENCE){
-                    double sup=(double)triple_cnt/(double)TOTAL_TRANSACTIONS;
-                    printf("{%d, %d} => {%d}, support=%.4f, confidence=%.4f\n",
-                        a,b,c, sup, conf);
-                    generated_rules++;
+            long long cons_cnt=getRuleCount(cons,nc,&w->probes);
+            r.lift=cons_cnt>0 ? conf*(double)TOTAL_TRANSACTIONS/(double)cons_cnt : 0.0;
+            r.score=r.lift;
+            bound=conf/sup;
+        } else {
+            r.score=RULE_RANK==RANK_SUPPORT ? sup : conf;
+            bound=r.score;
+        }
+        topRuleOffer(w->top,&w->ntop,&r);
+        // これ以上大きな結論部でもヒープに入れないなら打ち切る
+        return bound>=topRuleFloor(w->top,w->ntop);
+    }
+    appendRuleSide(w,set,k,h,0);
+    outStr(&w->out," => ");
+    appendRuleSide(w,set,k,h,1);
+    outStr(&w->out,", support=");
+    outFixed(&w->out,sup,4);
+    outStr(&w->out,", confidence=");
+    outFixed(&w->out,conf,4);
+    outChar(&w->out,'\n');
+    w->rules++;
+    return 1;
+}
+// set[0..k) (元のIDの昇順) から作れるルールをすべてバッファに書く
+void rulesFromItemset(const int *set, int k, long long cnt, struct ruleWork *w){
+    // m=1: 結論部が1個のルール
+    growRuleWork(w,k);
+    long long ncur=0;
+    for(int j=k-1;j>=0;j--){
+        uint64_t h=1ULL<<j;
+        if(tryRule(w,set,k,cnt,h)) w->cur[ncur++]=h;
+    }
+    // m → m+1: 通った結論部 h に、h の最上位より上の位置を1つ足す。
+    //   足した結果の m-部分集合がすべて通っていなければ試さない
+    for(int m=1;m+1<k && ncur>0;m++){
+        qsort(w->cur,ncur,sizeof(uint64_t),compareMask);
+        long long nnext=0;
+        for(long long i=0;i<ncur;i++){
+            uint64_t h=w->cur[i];
+            int top=63-__builtin_clzll(h);
+            for(int j=top+1;j<k;j++){
+                uint64_t cand=h|(1ULL<<j);
+                int ok=1;
+                for(uint64_t rest=h;rest && ok;rest&=rest-1){
+                    uint64_t sub=cand&~(rest&-rest);
+                    if(!bsearch(&sub,w->cur,ncur,sizeof(uint64_t),compareMask)) ok=0;
                 }
+                if(!ok) continue;
+                growRuleWork(w,nnext+1);
+                w->next[nnext++]=cand;
             }
-            // {a,c} => {b}
-            long long ac_cnt=getPairCountVal(a,c);
-            if(ac_cnt>0 && triple_cnt>0){
-                double conf=(double)triple_cnt/(double)ac_cnt;
-                if(conf>=MIN_CONFIDENCE){
-                    double sup=(double)triple_cnt/(double)TOTAL_TRANSACTIONS;
-                    printf("{%d, %d} => {%d}, support=%.4f, confidence=%.4f\n",
-                        a,c,b, sup, conf);
-                    generated_rules++;
-                }
+        }
+        ncur=0;
+        for(long long i=0;i<nnext;i++){
+            if(tryRule(w,set,k,cnt,w->next[i])) w->cur[ncur++]=w->next[i];
+        }
+    }
+}
+// 長さ k のセット1つから試すルール数の見込み (結論部の取り方 2^k-2、上限あり)
+static double ruleCost(int k){
+    return k < 20 ? (double)((1LL << k) - 2) : (double)(1 << 20);
+}
+// ルール抽出のスレッド: 区間 [begin, end) のセットからルールを作る
+static void* ruleThread(void *arg){
+    struct ruleWork *w=(struct ruleWork*)arg;
+    int set[MAX_ITEMSET_LEN];
+    long long base=0;
+    for(int k=2;k<=ruleMaxK;k++){
+        struct itemsetStore *l=ruleLevels[k];
+        if(!l) continue;
+        long long from=w->begin>base ? w->begin-base : 0;
+        long long to=w->end-base<l->n ? w->end-base : l->n;
+        for(long long i=from;i<to;i++){
+            if(TOP_K>0){
+                // f のルールの支持度は sup(f)、lift は 1/sup(f) を超えない
+                double supf=(double)l->counts[i]/(double)TOTAL_TRANSACTIONS;
+                double best=RULE_RANK==RANK_SUPPORT ? supf : RULE_RANK==RANK_LIFT ? 1.0/supf : 1.0;
+                if(best<topRuleFloor(w->top,w->ntop)) continue;
             }
-            // {b,c} => {a}
-            long long bc_cnt=getPairCountVal(b,c);
-            if(bc_cnt>0 && triple_cnt>0){
-                double conf=(double)triple_cnt/(double)bc_cnt;
-                if(conf>=MIN_CONFIDENCE){
-                    double sup=(double)triple_cnt/(double)TOTAL_TRANSACTIONS;
-                    printf("{%d, %d} => {%d}, support=%.4f, confidence=%.4f\n",
-                        b,c,a, sup, conf);
-                    generated_rules++;
-                }
+            ruleItems(l,i,set);
+            w->idx=i;
+            rulesFromItemset(set,k,l->counts[i],w);
+            // 行の途中で切らないように、セットの区切りでだけ書き出す
+            if(w->flushable && w->out.len>=OUT_BUFFER_SIZE) outFlush(&w->out);
+        }
+        base+=l->n;
+    }
+    return NULL;
+}
+// 各スレッドの上位K件を合わせて並べ替え、上位K件を先頭のバッファに書く
+static void writeTopRules(struct ruleWork *w, int nth){
+    long long n=0;
+    for(int t=0;t<nth;t++){
+        n+=w[t].ntop;
+    }
+    struct topRule *all=(struct topRule*)malloc(sizeof(struct topRule)*(n>0 ? n : 1));
+    if(!all){
+        fprintf(stderr,"Error: malloc failed\n");
+        exit(1);
+    }
+    n=0;
+    for(int t=0;t<nth;t++){
+        memcpy(&all[n],w[t].top,sizeof(struct topRule)*w[t].ntop);
+        n+=w[t].ntop;
+    }
+    qsort(all,n,sizeof(struct topRule),compareTopRule);
+    if(n>TOP_K) n=TOP_K;
+    int set[MAX_ITEMSET_LEN];
+    struct outBuf *o=&w[0].out;
+    for(long long i=0;i<n;i++){
+        const struct topRule *r=&all[i];
+        ruleItems(ruleLevels[r->k],r->idx,set);
+        appendRuleSide(&w[0],set,r->k,r->h,0);
+        outStr(o," => ");
+        appendRuleSide(&w[0],set,r->k,r->h,1);
+        outStr(o,", support=");
+        outFixed(o,(double)r->cnt/(double)TOTAL_TRANSACTIONS,4);
+        outStr(o,", confidence=");
+        outFixed(o,r->conf,4);
+        if(RULE_RANK==RANK_LIFT){
+            outStr(o,", lift=");
+            outFixed(o,r->lift,4);
+        }
+        outChar(o,'\n');
+    }
+    for(int t=0;t<nth;t++){
+        w[t].rules=0;
+    }
+    w[0].rules=n;
+    free(all);
+}
+// L2..Lk のすべての頻出アイテムセットからルールを作る
+void rulesFromLevels(){
+    if(!ruleOut) ruleOut=stdout;
+    long long total=0;
+    double totalCost=0.0;
+    for(int k=2;k<=ruleMaxK;k++){
+        if(!ruleLevels[k]) continue;
+        total+=ruleLevels[k]->n;
+        totalCost+=ruleCost(k)*(double)ruleLevels[k]->n;
+    }
+    int nth=NUM_THREADS;
+    struct ruleWork *w=(struct ruleWork*)calloc(nth,sizeof(struct ruleWork));
+    if(!w){
+        fprintf(stderr,"Error: malloc failed\n");
+        exit(1);
+    }
+    // 見込みの和がほぼ等しくなるように通し番号の区間を切る
+    int k=2;
+    long long i=0, g=0;
+    double acc=0.0;
+    for(int t=0;t<nth;t++){
+        w[t].id=t;
+        // 先頭の区間は前に出すものが無いので、ordered でもためずに出してよい
+        outInit(&w[t].out,ruleOut,&ruleOutLock,0);
+        w[t].flushable=RULE_ORDER==RULE_ORDER_ANY || t==0;
+        if(TOP_K>0){
+            w[t].top=(struct topRule*)malloc(sizeof(struct topRule)*TOP_K);
+            if(!w[t].top){
+                fprintf(stderr,"Error: malloc failed\n");
+                exit(1);
             }
-
-            p=p->next;
         }
+        w[t].begin=g;
+        double target=totalCost*(t+1)/nth;
+        while(g<total && (acc<target || t==nth-1)){
+            while(!ruleLevels[k] || i>=ruleLevels[k]->n){ k++; i=0; }
+            acc+=ruleCost(k);
+            i++;
+            g++;
+        }
+        w[t].end=g;
+    }
+    fflush(stdout);
+    runWorkers(ruleThread,w,sizeof(struct ruleWork),nth);
+    if(TOP_K>0) writeTopRules(w,nth);
+    struct outBuf **bufs=(struct outBuf**)malloc(sizeof(struct outBuf*)*nth);
+    if(!bufs){
+        fprintf(stderr,"Error: malloc failed\n");
+        exit(1);
+    }
+    for(int t=0;t<nth;t++){
+        bufs[t]=&w[t].out;
     }
+    outWriteAll(bufs,nth,ruleOut);
+    for(int t=0;t<nth;t++){
+        outFree(&w[t].out);
+        generated_rules+=w[t].rules;
+        ruleLookupProbes+=w[t].probes;
+        free(w[t].cur);
+        free(w[t].next);
+        free(w[t].top);
+    }
+    free(bufs);
+    free(w);
+    fflush(ruleOut);
 }
 
-
 // --------------------------------------------------
 // メイン関数
-//   ./kadai4 <transaction_file> <minsup> <minconf>
+//   ./kadai4 [options] <transaction_file> <minsup> <minconf>
+//   options:
+//     --threads N   頻度カウントを N スレッドで行う (既定 1)
+//     --engine E    マイニング方式 apriori (既定) / fpgrowth / eclat
+//     --counting M  Apriori の頻度カウント auto (既定) / htree / bitmap
+//     --lformat F   Lk ファイルの形式 text (Lk.dat, 既定) / binary (Lk.bin) / none (書かない)
+//     --rules-from S ルール抽出の入力 memory (マイニング結果を直接使う, 既定) / files (Lk を読み直す)
+//     --rule-order O ルールの出力順 ordered (スレッド数によらず同じ, 既定) / any (出来た順)
+//     --rules-out FILE ルールを stdout ではなく FILE に書く
+//     --output W    Lk.dat / ルールの書き方 stdio (既定) / direct (write/writev で直接書く)
+//     --top-k K     ルールを全部ではなく上位K件だけ出す
+//     --rank R      --top-k の順位付け confidence (既定) / lift / support
+//     --save-state S 候補と負の境界の頻度を S に保存する (差分更新用、Apriori で数える)
+//     --update S    S を読み、<transaction_file> を追加分として L1..Lk を更新して S に書き戻す
+//     --window N    直近 N 件のウィンドウを流しながら保ち、出入りしたアイテムセットを表示する
+//     --slide S     --window で一度に入れ替える件数 (既定は N/10)
+//     --stream EPS  1回だけ読む Lossy Counting で L1..L3 を近似する (誤差 EPS、- なら標準入力)
+//     --snapshot M  --stream で M 件ごとに L1..L3 を書き出す
+//     --pass1 P     パス1の数え方 exact (既定) / sketch (Count-Min で候補を絞ってから正確に数える)
+//     --sketch-width W  --pass1 sketch の1行のカウンタ数 (既定は平均長と minsup から決める)
+//     --sample M    約 M 件のサンプルでマイニングし、全体の走査 (通常1回) で確かめる (Toivonen)
+//   コンパイル: gcc -O2 -pthread kadai4.c -o kadai4
 // --------------------------------------------------
+static void usage(const char *prog) {
+    fprintf(stderr,"Usage: %s [--threads N] [--engine apriori|fpgrowth|eclat] [--counting auto|htree|bitmap] [--lformat text|binary|none] [--rules-from memory|files] [--rule-order ordered|any] [--rules-out FILE] [--output stdio|direct] [--top-k K] [--rank confidence|lift|support] [--save-state S] [--update S] [--window N] [--slide S] [--stream EPS] [--snapshot M] [--pass1 exact|sketch] [--sketch-width W] [--sample M] <transaction_file> <minsup> <minconf>\n", prog);
+    exit(1);
+}
+// "--name=value" / "--name value" のどちらでも値を取り出す
+static const char* optionValue(int argc, char **argv, int *i, const char *name) {
+    size_t len = strlen(name);
+    if (strncmp(argv[*i], name, len) != 0) return NULL;
+    if (argv[*i][len] == '=') return argv[*i] + len + 1;
+    if (argv[*i][len] == '\0') {
+        if (*i + 1 >= argc) usage(argv[0]);
+        return argv[++(*i)];
+    }
+    return NULL;
+}
+
 int main(int argc,char **argv){
-    if(argc!=4){
-        fprintf(stderr,"Usage: %s <transaction_file> <minsup> <minconf>\n", argv[0]);
-        return 1;
+    const char *args[3];
+    int nargs = 0;
+    const char *rules_out_file = NULL;
+    const char *state_in = NULL, *state_out = NULL;
+    for (int i = 1; i < argc; i++) {
+        const char *v;
+        if ((v = optionValue(argc, argv, &i, "--threads"))) {
+            NUM_THREADS = atoi(v);
+            if (NUM_THREADS < 1) NUM_THREADS = 1;
+        } else if ((v = optionValue(argc, argv, &i, "--engine"))) {
+            if (strcmp(v, "apriori") == 0) MINING_ENGINE = ENGINE_APRIORI;
+            else if (strcmp(v, "fpgrowth") == 0) MINING_ENGINE = ENGINE_FPGROWTH;
+            else if (strcmp(v, "eclat") == 0) MINING_ENGINE = ENGINE_ECLAT;
+            else usage(argv[0]);
+        } else if ((v = optionValue(argc, argv, &i, "--counting"))) {
+            if (strcmp(v, "auto") == 0) COUNTING_MODE = COUNT_AUTO;
+            else if (strcmp(v, "htree") == 0) COUNTING_MODE = COUNT_HTREE;
+            else if (strcmp(v, "bitmap") == 0) COUNTING_MODE = COUNT_BITMAP;
+            else usage(argv[0]);
+        } else if ((v = optionValue(argc, argv, &i, "--lformat"))) {
+            if (strcmp(v, "text") == 0) LFILE_FORMAT = LFORMAT_TEXT;
+            else if (strcmp(v, "binary") == 0) LFILE_FORMAT = LFORMAT_BINARY;
+            else if (strcmp(v, "none") == 0) LFILE_FORMAT = LFORMAT_NONE;
+            else usage(argv[0]);
+        } else if ((v = optionValue(argc, argv, &i, "--rule-order"))) {
+            if (strcmp(v, "ordered") == 0) RULE_ORDER = RULE_ORDER_ORDERED;
+            else if (strcmp(v, "any") == 0) RULE_ORDER = RULE_ORDER_ANY;
+            else usage(argv[0]);
+        } else if ((v = optionValue(argc, argv, &i, "--output"))) {
+            if (strcmp(v, "stdio") == 0) OUTPUT_MODE = OUTPUT_STDIO;
+            else if (strcmp(v, "direct") == 0) OUTPUT_MODE = OUTPUT_DIRECT;
+            else usage(argv[0]);
+        } else if ((v = optionValue(argc, argv, &i, "--top-k"))) {
+            TOP_K = atoll(v);
+            if (TOP_K < 1) usage(argv[0]);
+        } else if ((v = optionValue(argc, argv, &i, "--rank"))) {
+            if (strcmp(v, "confidence") == 0) RULE_RANK = RANK_CONFIDENCE;
+            else if (strcmp(v, "lift") == 0) RULE_RANK = RANK_LIFT;
+            else if (strcmp(v, "support") == 0) RULE_RANK = RANK_SUPPORT;
+            else usage(argv[0]);
+        } else if ((v = optionValue(argc, argv, &i, "--update"))) {
+            state_in = v;
+        } else if ((v = optionValue(argc, argv, &i, "--save-state"))) {
+            state_out = v;
+        } else if ((v = optionValue(argc, argv, &i, "--window"))) {
+            WINDOW_SIZE = atoll(v);
+            if (WINDOW_SIZE < 1) usage(argv[0]);
+        } else if ((v = optionValue(argc, argv, &i, "--slide"))) {
+            WINDOW_SLIDE = atoll(v);
+            if (WINDOW_SLIDE < 1) usage(argv[0]);
+        } else if ((v = optionValue(argc, argv, &i, "--pass1"))) {
+            if (strcmp(v, "exact") == 0) PASS1_MODE = PASS1_EXACT;
+            else if (strcmp(v, "sketch") == 0) PASS1_MODE = PASS1_SKETCH;
+            else usage(argv[0]);
+        } else if ((v = optionValue(argc, argv, &i, "--sketch-width"))) {
+            SKETCH_WIDTH = atoll(v);
+            if (SKETCH_WIDTH < 1) usage(argv[0]);
+        } else if ((v = optionValue(argc, argv, &i, "--sample"))) {
+            SAMPLE_SIZE = atoll(v);
+            if (SAMPLE_SIZE < 1) usage(argv[0]);
+        } else if ((v = optionValue(argc, argv, &i, "--stream"))) {
+            STREAM_EPSILON = atof(v);
+            if (!(STREAM_EPSILON > 0.0)) usage(argv[0]);
+        } else if ((v = optionValue(argc, argv, &i, "--snapshot"))) {
+            STREAM_SNAPSHOT = atoll(v);
+            if (STREAM_SNAPSHOT < 1) usage(argv[0]);
+        } else if ((v = optionValue(argc, argv, &i, "--rules-out"))) {
+            rules_out_file = v;
+        } else if ((v = optionValue(argc, argv, &i, "--rules-from"))) {
+            if (strcmp(v, "memory") == 0) RULES_SOURCE = RULES_FROM_MEMORY;
+            else if (strcmp(v, "files") == 0) RULES_SOURCE = RULES_FROM_FILES;
+            else usage(argv[0]);
+        } else if (strncmp(argv[i], "--", 2) == 0 || nargs >= 3) {
+            usage(argv[0]);
+        } else {
+            args[nargs++] = argv[i];
+        }
+    }
+    if (nargs != 3) usage(argv[0]);
+    if (RULES_SOURCE == RULES_FROM_FILES && LFILE_FORMAT == LFORMAT_NONE) {
+        fprintf(stderr, "Error: --rules-from files needs --lformat text or binary\n");
+        exit(1);
+    }
+    if ((state_in || state_out) && MINING_ENGINE != ENGINE_APRIORI) {
+        fprintf(stderr, "Error: --update / --save-state count with Apriori; --engine fpgrowth / eclat cannot be combined\n");
+        exit(1);
+    }
+    if (WINDOW_SIZE > 0 && (state_in || state_out)) {
+        fprintf(stderr, "Error: --window cannot be combined with --update / --save-state\n");
+        exit(1);
+    }
+    if (WINDOW_SIZE > 0 && MINING_ENGINE != ENGINE_APRIORI) {
+        fprintf(stderr, "Error: --window keeps its own bitmap lattice; --engine fpgrowth / eclat cannot be combined\n");
+        exit(1);
+    }
+    const char *transaction_file=args[0];
+    MIN_SUPPORT_RATIO = atof(args[1]);
+    MIN_CONFIDENCE = atof(args[2]);
+    int streaming = STREAM_EPSILON > 0.0;
+    if (streaming && (WINDOW_SIZE > 0 || state_in || state_out)) {
+        fprintf(stderr, "Error: --stream cannot be combined with --window / --update / --save-state\n");
+        exit(1);
+    }
+    if (streaming && MINING_ENGINE != ENGINE_APRIORI) {
+        fprintf(stderr, "Error: --stream uses Lossy Counting; --engine fpgrowth / eclat cannot be combined\n");
+        exit(1);
+    }
+    int sampling = SAMPLE_SIZE > 0;
+    if (sampling && (streaming || WINDOW_SIZE > 0 || state_in || state_out)) {
+        fprintf(stderr, "Error: --sample cannot be combined with --stream / --window / --update / --save-state\n");
+        exit(1);
+    }
+    if (sampling && MINING_ENGINE != ENGINE_APRIORI) {
+        fprintf(stderr, "Error: --sample verifies the sample lattice itself; --engine fpgrowth / eclat cannot be combined\n");
+        exit(1);
+    }
+    if (streaming && STREAM_EPSILON >= MIN_SUPPORT_RATIO) {
+        fprintf(stderr, "Error: --stream epsilon must be smaller than minsup\n");
+        exit(1);
     }
-    const char *transaction_file=argv[1];
-    MIN_SUPPORT_RATIO = atof(argv[2]);
-    MIN_CONFIDENCE = atof(argv[3]);
 
-    // (1) トランザクション数を数える
-    clock_t t0 = clock();
-    TOTAL_TRANSACTIONS = countTransactions(transaction_file);
-    clock_t t1 = clock();
-    double tx_count_time = (double)(t1 - t0)/CLOCKS_PER_SEC;
+    // (1) トランザクションファイルを読み込み、トランザクション数を数える
+    double t0 = nowSec();
+    //     --stream のときは読み込まずに流しながら数える
+    struct tranDB *db = streaming ? NULL : loadTransactions(transaction_file);
+    TOTAL_TRANSACTIONS = db ? countTransactions(db) : 0;
+    double tx_count_time = nowSec() - t0;
 
     // (2) pass1 => L1.dat
-    long long total_t = pass1_generateL1(transaction_file, "L1.dat");
-    // (3) pass2 => L2.dat
-    long long l2_count = pass2_generateL2(transaction_file, "L1.dat", total_t);
-    // (4) pass3 => L3.dat
-    long long l3_count = pass3_generateL3(transaction_file, total_t);
-
-    // 表示
-    printf("=== Pass1 -> L1.dat ===\n");
-    printf("Total transactions: %lld\n", total_t);
-    printf("Pass1 time: %.3f sec\n", pass1_time);
-
-    printf("=== Pass2 -> L2.dat ===\n");
-    printf("Found %lld frequent pairs\n", l2_count);
-    printf("Pass2 time: %.3f sec\n", pass2_time);
-
-    printf("=== Pass3 -> L3.dat ===\n");
-    printf("Found %lld frequent triples\n", l3_count);
-    printf("Pass3 time: %.3f sec\n", pass3_time);
-
-    // メモリ解放(パス1,2,3)
-    freeItemHash();
-    freePairHash();
-    freeTripleHash();
+    //     --update / --save-state のときは状態ファイルを使って L1..Lk をまとめて更新する
+    //     --window のときは最後のウィンドウの L1..Lk をまとめて求める
+    //     --stream のときは Lossy Counting で近似した L1..L3 をまとめて求める
+    //     --sample のときはサンプルから求めて全体で確かめた L1..Lk をまとめて求める
+    long long total_t = 0;
+    struct mineResult res;
+    memset(&res, 0, sizeof(res));
+    res.maxk = 1;
+    int updating = state_in || state_out;
+    int windowing = WINDOW_SIZE > 0;
+    int mined_maxk = 0;
+    struct itemsetStore *l1;
+    char filename[64];
+    if (updating) {
+        struct mineState st;
+        memset(&st, 0, sizeof(st));
+        if (state_in) loadState(state_in, &st);
+        mined_maxk = updateGenerateLk(db, transaction_file, &st, &total_t, &res);
+        saveState(state_out ? state_out : state_in, &st);
+        freeMineState(&st);
+        TOTAL_TRANSACTIONS = total_t;
+        l1 = res.levels[1];
+    } else if (windowing) {
+        mined_maxk = windowGenerateLk(db, &total_t, &res);
+        TOTAL_TRANSACTIONS = total_t;
+        l1 = res.levels[1];
+    } else if (streaming) {
+        mined_maxk = streamGenerateLk(transaction_file, &total_t, &res);
+        TOTAL_TRANSACTIONS = total_t;
+        l1 = res.levels[1];
+    } else if (sampling) {
+        mined_maxk = sampleGenerateLk(db, &total_t, &res);
+        TOTAL_TRANSACTIONS = total_t;
+        l1 = res.levels[1];
+    } else {
+        l1 = pass1_generateL1(db, &total_t);
+
+        levelFileName(1, filename, sizeof(filename));
+        printf("=== Pass1 -> %s ===\n", filename);
+        printf("Total transactions: %lld\n", total_t);
+        printf("Pass1 time: %.3f sec\n", pass_time[1]);
+        if (PASS1_MODE == PASS1_SKETCH) {
+            printf("Pass1 sketch: %d x %lld counters (%.1f MB), %lld candidates verified, %lld frequent\n",
+                   SKETCH_DEPTH, SKETCH_WIDTH, (double)(SKETCH_DEPTH * SKETCH_WIDTH * sizeof(uint32_t)) / (1024.0 * 1024.0),
+                   sketch_candidates, l1->n);
+        }
+        printf("Remaining transactions: %lld (items: %lld)\n", db->n, db->nitems);
+    }
+
+    // (3) passk => Lk.dat  (L_k が空になるまで繰り返す)
+    //     ルール抽出で L2, L3 を使うので、パス3までは必ず実行する
+    //     FP-Growth / Eclat のときは L2..Lk をまとめて求める
+    //     L1..Lk はすべて res に残し、ルール抽出にそのまま渡す
+    res.levels[1] = l1;
+    struct itemsetStore *prev = l1;
+    int max_k = 1;
+    if (updating || windowing || streaming || sampling) {
+        max_k = mined_maxk;
+        prev = res.levels[max_k];
+    } else if (MINING_ENGINE == ENGINE_FPGROWTH) {
+        max_k = fpgrowth_generateLk(db, l1, total_t, &res);
+    } else if (MINING_ENGINE == ENGINE_ECLAT) {
+        max_k = eclat_generateLk(db, l1, total_t, &res);
+    }
+    for (int k = 2; k <= MAX_ITEMSET_LEN && MINING_ENGINE == ENGINE_APRIORI && !updating && !windowing && !streaming && !sampling; k++) {
+        if (prev->n == 0 && k > 3) break;
+        struct itemsetStore *l = passK_generateLk(db, l1, prev, total_t);
+        res.levels[k] = l;
+        res.maxk = k;
+        prev = l;
+        max_k = k;
 
-    // (5) 相関ルール抽出
-    clock_t rule_start = clock();
-    loadL1("L1.dat");
-    loadL2("L2.dat");
-    loadL3("L3.dat");
+        levelFileName(k, filename, sizeof(filename));
+        printf("=== Pass%d -> %s ===\n", k, filename);
+        if (k == 2)      printf("Found %lld frequent pairs\n", l->n);
+        else if (k == 3) printf("Found %lld frequent triples\n", l->n);
+        else             printf("Found %lld frequent %d-itemsets\n", l->n, k);
+        printf("Pass%d time: %.3f sec\n", k, pass_time[k]);
+        printf("Remaining transactions: %lld (items: %lld)\n", db->n, db->nitems);
+    }
+    if (prev->n > 0 && max_k == MAX_ITEMSET_LEN) {
+        fprintf(stderr, "Warning: stopped at MAX_ITEMSET_LEN=%d\n", MAX_ITEMSET_LEN);
+    }
+
+    // メモリ解放(パス1..k の作業領域。L1..Lk は res に残す)
+    freeArena(htree_arena);
+    htree_arena = NULL;
+    freeTransactions(db);
+
+    // (4) 相関ルール抽出
+    double rule_start = nowSec();
+    if (RULES_SOURCE == RULES_FROM_MEMORY) {
+        useMinedLevels(&res, max_k);
+    } else {
+        loadLevels(max_k);
+    }
 
-    printf("\n=== Association Rules (confidence >= %.2f) ===\n", MIN_CONFIDENCE);
+    if (TOP_K > 0) {
+        printf("\n=== Top %lld Association Rules by %s (confidence >= %.2f) ===\n",
+               TOP_K, rankName[RULE_RANK], MIN_CONFIDENCE);
+    } else {
+        printf("\n=== Association Rules (confidence >= %.2f) ===\n", MIN_CONFIDENCE);
+    }
+    if (rules_out_file) {
+        ruleOut = fopen(rules_out_file, "w");
+        if (!ruleOut) {
+            fprintf(stderr, "Error: cannot open %s for writing\n", rules_out_file);
+            exit(1);
+        }
+        printf("(written to %s)\n", rules_out_file);
+    }
 
-    rulesFromL2();
-    rulesFromL3();
+    rulesFromLevels();
 
-    clock_t rule_end = clock();
-    rule_time = (double)(rule_end - rule_start)/CLOCKS_PER_SEC;
+    rule_time = nowSec() - rule_start;
 
     // 解放
-    freeItemCountHash();
-    freePairCountHash();
-    freeTripleCountHash();
+    if (ruleOut && ruleOut != stdout) fclose(ruleOut);
+    freeRuleLevels();
+    for (int k = 1; k <= MAX_ITEMSET_LEN; k++) {
+        freeItemsetStore(res.levels[k]);
+    }
 
     // まとめて出力
     printf("\n=== Performance Summary ===\n");
-    printf("Transaction counting time: %.3f sec\n", tx_count_time);
-    printf("Pass1 time: %.3f sec\n", pass1_time);
-    printf("Pass2 time: %.3f sec\n", pass2_time);
-    printf("Pass3 time: %.3f sec\n", pass3_time);
+    printf("Transaction loading time: %.3f sec\n", tx_count_time);
+    if (sampling) {
+        printf("Sample time: %.3f sec\n", sample_time);
+        printf("Sample: %lld transactions (minsup %.6f), full scans: %d, border misses: %lld\n",
+               sample_drawn, sample_minsup, sample_scans, sample_misses);
+    } else if (streaming) {
+        printf("Stream time: %.3f sec\n", stream_time);
+        printf("Stream snapshots: %lld (pruned entries: %lld, peak entries: %lld)\n",
+               stream_snapshots, stream_pruned, stream_entries_peak);
+    } else if (windowing) {
+        printf("Window time: %.3f sec\n", window_time);
+        printf("Window slides: %lld (rebuilds: %lld)\n", window_slides, window_rebuilds);
+        printf("Window candidates counted from scratch: %lld (words: %lld)\n", window_fresh, window_words);
+    } else if (MINING_ENGINE == ENGINE_FPGROWTH) {
+        printf("Pass1 time: %.3f sec\n", pass_time[1]);
+        printf("FP-tree build time: %.3f sec\n", fp_build_time);
+        printf("FP-growth mining time: %.3f sec\n", fp_mine_time);
+        printf("FP-tree nodes: %lld\n", fp_nodes);
+    } else if (MINING_ENGINE == ENGINE_ECLAT) {
+        printf("Pass1 time: %.3f sec\n", pass_time[1]);
+        printf("Vertical DB build time: %.3f sec\n", eclat_build_time);
+        printf("Eclat mining time: %.3f sec\n", eclat_mine_time);
+        printf("Tid-list operations: %lld (tids read: %lld)\n", eclat_ops, eclat_tids);
+    } else {
+        for (int k = 1; k <= max_k; k++) {
+            printf("Pass%d time: %.3f sec\n", k, pass_time[k]);
+        }
+    }
     printf("Rules generation time: %.3f sec\n", rule_time);
+    printf("Arena peak: %.1f MB\n", (double)arena_peak / (1024.0 * 1024.0));
 
     // ハッシュ探索回数などを表示
     printf("\n=== Hash Search Stats ===\n");
     printf("searchItem_calls       = %lld\n", searchItem_calls);
     printf("searchItem_traversals  = %lld\n", searchItem_traversals);
-    printf("searchPair_calls       = %lld\n", searchPair_calls);
-    printf("searchPair_traversals  = %lld\n", searchPair_traversals);
-    printf("searchTriple_calls     = %lld\n", searchTriple_calls);
-    printf("searchTriple_traversals= %lld\n", searchTriple_traversals);
+    printf("searchPair_calls       = %lld\n", searchItemset_calls[2]);
+    printf("searchPair_traversals  = %lld\n", searchItemset_traversals[2]);
+    printf("searchTriple_calls     = %lld\n", searchItemset_calls[3]);
+    printf("searchTriple_traversals= %lld\n", searchItemset_traversals[3]);
+    for (int k = 4; k <= max_k; k++) {
+        printf("searchK%d_calls         = %lld\n", k, searchItemset_calls[k]);
+        printf("searchK%d_traversals    = %lld\n", k, searchItemset_traversals[k]);
+    }
+    for (int k = 2; k <= max_k; k++) {
+        printf("htreeK%d_visits         = %lld\n", k, htree_visits[k]);
+        printf("htreeK%d_checks         = %lld\n", k, htree_checks[k]);
+        printf("bitmapK%d_words         = %lld\n", k, bitmap_words[k]);
+    }
 
     // ルール数
     printf("\nTotal generated rules: %lld\n", generated_rules);
 
-    printf("\nProgram finished (kadai4: path1->path2->path3->association-rules)\n");
+    printf("\nProgram finished (kadai4: path1->path2->...->pathK->association-rules)\n");
     return 0;
 }
@@ -0,0 +1,83 @@
+/*
+ * kadai4 の --lformat binary で書いた Lk.bin をテキストに直して表示する
+ *
+ *   ./ldump L2.bin [L3.bin ...]
+ *   出力は Lk.dat と同じ "item1 ... itemk count support" 形式
+ *   コンパイル: gcc -O2 ldump.c -o ldump
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#define LFILE_MAGIC "KDLKBIN1"
+
+/* kadai4.c の struct lfileHeader と同じ並び */
+struct lfileHeader {
+    char magic[8];
+    int32_t k;
+    int32_t flags;
+    int64_t n;
+    int64_t total_t;
+};
+
+/* 頻度の列の位置 (アイテムの直後を 8バイト境界にそろえる)
+ * long は Windows では 32bit なので、2GB を超えるファイルでも溢れないよう size_t で求める */
+static size_t lfileCountsOffset(long long n, int k) {
+    size_t off = sizeof(struct lfileHeader) + sizeof(int32_t) * (size_t)n * (size_t)k;
+    return (off + 7) & ~(size_t)7;
+}
+
+static void dumpFile(const char *filename) {
+    FILE *fp = fopen(filename, "rb");
+    if (!fp) {
+        fprintf(stderr, "Error: cannot open %s\n", filename);
+        exit(1);
+    }
+    struct lfileHeader h;
+    if (fread(&h, sizeof(h), 1, fp) != 1 || memcmp(h.magic, LFILE_MAGIC, sizeof(h.magic)) != 0
+        || h.k < 1 || h.n < 0) {
+        fprintf(stderr, "Error: %s is not a binary L-file\n", filename);
+        exit(1);
+    }
+    int32_t *items = (int32_t*)malloc(sizeof(int32_t) * (size_t)h.k * (size_t)(h.n > 0 ? h.n : 1));
+    int64_t *counts = (int64_t*)malloc(sizeof(int64_t) * (h.n > 0 ? h.n : 1));
+    if (!items || !counts) {
+        fprintf(stderr, "Error: malloc failed\n");
+        exit(1);
+    }
+    /* 頻度の列までの詰め物 (8バイト未満) は fseek せずに読み飛ばす */
+    size_t nitems = (size_t)h.n * (size_t)h.k;
+    size_t pad = lfileCountsOffset(h.n, h.k) - sizeof(h) - sizeof(int32_t) * nitems;
+    char zeros[8];
+    if (fread(items, sizeof(int32_t), nitems, fp) != nitems
+        || fread(zeros, 1, pad, fp) != pad
+        || fread(counts, sizeof(int64_t), (size_t)h.n, fp) != (size_t)h.n) {
+        fprintf(stderr, "Error: %s is truncated\n", filename);
+        exit(1);
+    }
+    fclose(fp);
+
+    for (long long i = 0; i < h.n; i++) {
+        for (int j = 0; j < h.k; j++) {
+            printf("%d ", items[i * h.k + j]);
+        }
+        /* 総トランザクション数が 0 のファイル (空のDB) では支持度を 0 とする */
+        double sup = h.total_t > 0 ? (double)counts[i] / (double)h.total_t : 0.0;
+        printf("%lld %.6f\n", (long long)counts[i], sup);
+    }
+    free(items);
+    free(counts);
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s <Lk.bin> [Lk.bin ...]\n", argv[0]);
+        return 1;
+    }
+    for (int i = 1; i < argc; i++) {
+        dumpFile(argv[i]);
+    }
+    return 0;
+}
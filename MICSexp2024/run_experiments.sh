@@ -34,8 +34,8 @@ do
 done
 
 # ----
-# 必要なら、ハッシュサイズを変えたバージョンの実行もここで追記可能
-#  (例: kadai4_50k, kadai4_100k など別々にコンパイルしたバイナリを呼ぶ)
+# ハッシュ表は候補数の見込みから大きさを決め、使用率に応じて自分で広がるので、
+# ハッシュサイズを変えたバイナリを別々にコンパイルする必要はない
 # ----
 
 echo "All experiments finished. Results are in the 'result' directory."